@@ -289,6 +289,9 @@ public:
             }
 
             _eventSource->setFrame(i);
+            // read the next frame while this one is voxelized
+            if (i + 1 < frameRange.y())
+                _eventSource->prefetchFrame(i + 1);
             source->Modified();
 
             if (_vm.count("export-volume"))
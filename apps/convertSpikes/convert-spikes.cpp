@@ -0,0 +1,97 @@
+
+/* Copyright (c) 2017, EPFL/Blue Brain Project
+ *
+ * This file is part of Fivox <https://github.com/BlueBrain/Fivox>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of Eyescale Software GmbH nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <fivox/spikeStore.h>
+#include <fivox/uriHandler.h>
+#include <fivox/version.h>
+
+#include <boost/program_options.hpp>
+#include <brion/blueConfig.h>
+#include <lunchbox/log.h>
+
+namespace po = boost::program_options;
+
+int main(int argc, char* argv[])
+{
+    po::options_description options(
+        "Convert the spike report of a volume into a binary spike store, "
+        "used instead of the report by the spike loader");
+    // clang-format off
+    options.add_options()
+//! [ConvertSpikesParameters] @anchor ConvertSpikes
+        ("help,h", "Show help message")
+        ("version,v", "Show program name and version")
+        ("volume", po::value<std::string>(),
+         "Spike volume URI, e.g. fivoxspikes:///path/to/BlueConfig or "
+         "fivoxspikes://?spikes=/path/to/out.dat, see voxelize --help")
+        ("output,o", po::value<std::string>(),
+         "Path of the spike store. Defaults to the cache file next to the "
+         "spike report, which is picked up automatically by the spike "
+         "loader");
+//! [ConvertSpikesParameters]
+    // clang-format on
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, options), vm);
+    po::notify(vm);
+
+    if (vm.count("help"))
+    {
+        std::cout << options << std::endl;
+        return EXIT_SUCCESS;
+    }
+
+    if (vm.count("version"))
+    {
+        std::cout << argv[0] << " version " << fivox::Version::getString()
+                  << std::endl;
+        return EXIT_SUCCESS;
+    }
+
+    const fivox::URIHandler params(fivox::URI(
+        vm.count("volume") ? vm["volume"].as<std::string>() : "fivoxspikes://"));
+    const std::string& spikePath = params.getSpikes();
+    const fivox::URI report = spikePath.empty()
+                                  ? params.getConfig().getSpikeSource()
+                                  : fivox::URI(spikePath);
+
+    const std::string output =
+        vm.count("output") ? vm["output"].as<std::string>()
+                           : fivox::SpikeStore::getCachePath(report);
+    if (output.empty())
+    {
+        LBERROR << "No cache path for spike report " << report
+                << ", please specify an output file" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    fivox::SpikeStore::convert(report, output);
+    return EXIT_SUCCESS;
+}
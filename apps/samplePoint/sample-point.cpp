@@ -106,6 +106,8 @@ public:
         for (uint32_t i = frameRange.x(); i < frameRange.y(); ++i)
         {
             eventSource->setFrame(i);
+            if (i + 1 < frameRange.y())
+                eventSource->prefetchFrame(i + 1);
             eventSource->load(0, eventSource->getNumChunks());
             const float value =
                 (*functor)(itkPoint, fivox::FloatVolume::SpacingType());
@@ -51,9 +51,17 @@ class Launcher(object): # pylint: disable=too-few-public-methods
         self._args = args
         self._args.resolution = 1./self._args.resolution
         self._volume = 'fivoxsynapses://{config}?resolution={resolution}&'
+        self._outnames = None
         if args.target:
             self._volume += 'target={target}'
             self._outname = 'density_{target}'.format(**vars(self._args))
+        elif args.pathways:
+            # one volume per presynaptic target from a single voxelization
+            pre, post = args.pathways[:-1], args.pathways[-1]
+            self._volume += 'preTarget={0}&postTarget={1}&groupBy=preTarget'.format(
+                ','.join(pre), post)
+            self._outname = 'density_{0}'.format('_'.join(args.pathways))
+            self._outnames = pre
         else:
             self._volume += 'preTarget={projection[0]}&postTarget={projection[1]}'
             self._outname = 'density_{projection[0]}_{projection[1]}'.format(**vars(self._args))
@@ -71,19 +79,27 @@ class Launcher(object): # pylint: disable=too-few-public-methods
             print(self._volume)
 
         hash_object = hashlib.md5(str(self._volume))
-        self._outname += "_{0}.nrrd".format(hash_object.hexdigest()[:7])
+        self._outname += "_{0}".format(hash_object.hexdigest()[:7])
         self._outname = os.path.abspath(self._outname)
+        if self._outnames:
+            self._outnames = ["{0}_{1}.nrrd".format(self._outname, pre)
+                              for pre in self._outnames]
+        else:
+            self._outnames = [self._outname + ".nrrd"]
+        self._outname += ".nrrd"
 
     def launch(self):
         """
         Launch livre or voxelize and/or paraview.
         """
 
-        if os.path.exists(self._outname):
-            print("Reusing previously generated volume {0}".format(self._outname))
+        exists = all(os.path.exists(name) for name in self._outnames)
+        if exists:
+            print("Reusing previously generated volume(s) {0}".format(
+                ' '.join(self._outnames)))
 
         if self._args.tool == 'livre':
-            if os.path.exists(self._outname):
+            if exists and len(self._outnames) == 1:
                 volume = "raw://{0}".format(self._outname)
             else:
                 volume = self._volume
@@ -94,12 +110,12 @@ class Launcher(object): # pylint: disable=too-few-public-methods
             subprocess.call(args)
 
         if self._args.tool == 'voxelize' or self._args.tool == 'paraview':
-            if not os.path.exists(self._outname):
+            if not exists:
                 subprocess.call(['voxelize', '--volume', self._volume,
                                  '-o', self._outname])
 
             if self._args.tool == 'paraview':
-                args = ['paraview', self._outname]
+                args = ['paraview'] + self._outnames
                 if self._usevgl:
                     args.insert(0, 'vglrun')
                 subprocess.call(args)
@@ -135,6 +151,10 @@ def main():
                        help="target for afferent synapses")
     group.add_argument('-p', "--projection", nargs=2, metavar=('pre', 'post'),
                        help="targets for synaptic projections")
+    group.add_argument('-P', "--pathways", nargs='+', metavar='target',
+                       help="presynaptic targets followed by the postsynaptic "
+                            "target, voxelized in one pass into one volume "
+                            "per presynaptic target")
     parser.add_argument("-f", "--fraction", metavar='<GID fraction>',
                         help="fraction of GIDs to use [0,1]")
     parser.add_argument("-d", "--datarange", nargs=2, metavar=('min', 'max'),
@@ -146,6 +166,9 @@ def main():
     parser.add_argument("-v", "--verbose", action="store_true",
                         help="Print volume URI")
     args = parser.parse_args()
+    if args.pathways and len(args.pathways) < 2:
+        parser.error("--pathways needs at least one pre- and one postsynaptic "
+                     "target")
 
     launcher = Launcher(args)
     launcher.launch()
@@ -34,6 +34,8 @@
 #include "../commandLineApplication.h"
 #include "../volumeWriter.h"
 
+#include <brain/circuit.h>
+
 namespace
 {
 void _getNameAndExtension(const std::string& filePath, std::string& outputName,
@@ -60,30 +62,47 @@ template <typename T>
 void _sample(ImageSourcePtr source, const vmml::Vector2ui& frameRange,
              const fivox::URIHandler& params, const std::string& filePath)
 {
-    VolumePtr input = source->GetOutput();
-    VolumeWriter<T> writer(input, params.getInputRange());
-
+    // one volume per channel of grouped events, named after the group
     std::string outputName, extension;
     _getNameAndExtension(filePath, outputName, extension);
+    std::vector<std::unique_ptr<VolumeWriter<T>>> writers;
+    std::vector<std::string> outputNames;
+    for (size_t c = 0; c < source->getNumChannels(); ++c)
+    {
+        VolumePtr input = source->GetOutput(c);
+        writers.emplace_back(
+            new VolumeWriter<T>(input, params.getInputRange()));
+        outputNames.push_back(source->getNumChannels() > 1
+                                  ? outputName + "_" + source->getChannelName(c)
+                                  : outputName);
+    }
 
     const size_t numDigits = std::to_string(frameRange.y()).length();
+    ::fivox::EventSourcePtr loader = source->getEventSource();
     for (uint32_t i = frameRange.x(); i < frameRange.y(); ++i)
     {
-        source->getEventSource()->setFrame(i);
+        loader->setFrame(i);
+        // read the next frame while this one is voxelized
+        if (i + 1 < frameRange.y())
+            loader->prefetchFrame(i + 1);
 
-        std::string volumeName = outputName + extension;
-        if (frameRange.y() - frameRange.x() > 1)
+        source->Modified();
+        for (size_t c = 0; c < writers.size(); ++c)
         {
-            std::ostringstream os;
-            os << outputName << std::setfill('0') << std::setw(numDigits) << i
-               << extension;
-            volumeName = os.str();
-        }
+            std::string volumeName = outputNames[c] + extension;
+            if (frameRange.y() - frameRange.x() > 1)
+            {
+                std::ostringstream os;
+                os << outputNames[c] << std::setfill('0')
+                   << std::setw(numDigits) << i << extension;
+                volumeName = os.str();
+            }
 
-        writer->SetFileName(volumeName);
-        source->Modified();
-        writer->Update(); // Run pipeline to write volume
-        LBINFO << "Volume written as " << volumeName << std::endl;
+            VolumeWriter<T>& writer = *writers[c];
+            writer->SetFileName(volumeName);
+            writer->Update(); // Run pipeline once, write all channels
+            LBINFO << "Volume written as " << volumeName << std::endl;
+        }
     }
 }
 }
@@ -112,6 +131,10 @@ public:
              "number if --frames or --times")
             ("decompose", po::value<fivox::Vector2ui>(),
              "'rank size' data-decomposition for parallel job submission")
+            ("max-cell-extent", po::value<float>()->default_value(2000.f),
+             "Maximum distance in micrometers of the events of a cell from "
+             "its soma, to load only the cells near the part of the volume "
+             "of a --decompose job; 0 loads all cells")
             ("export-events", po::value<std::string>(),
              "Name of the output events file (binary format)");
 //! [VoxelizeParameters]
@@ -147,7 +170,9 @@ public:
         if (_vm.count("size"))
             uri.addQuery("size", std::to_string(_vm["size"].as<size_t>()));
 
-        const ::fivox::URIHandler params(uri);
+        ::fivox::URIHandler params(uri);
+        if (_decompose[1] > 1)
+            _selectCells(params);
         auto source = params.newImageSource<fivox::FloatVolume>();
 
         const fivox::Vector3f& extent(source->getSizeInMicrometer());
@@ -156,12 +181,30 @@ public:
         const fivox::VolumeHandler volumeHandler(size, extent);
         VolumePtr output = source->GetOutput();
 
-        output->SetRegions(volumeHandler.computeRegion(_decompose));
+        const fivox::FloatVolume::RegionType& region =
+            volumeHandler.computeRegion(_decompose);
+        output->SetRegions(region);
         output->SetSpacing(volumeHandler.computeSpacing());
         const fivox::AABBf& bbox = source->getBoundingBox();
         output->SetOrigin(volumeHandler.computeOrigin(bbox.getCenter()));
 
         ::fivox::EventSourcePtr loader = source->getEventSource();
+        if (_decompose[1] > 1)
+        {
+            // only the events within the cutoff distance of the voxels of
+            // this part of the volume contribute to it
+            fivox::FloatVolume::PointType first, last;
+            output->TransformIndexToPhysicalPoint(region.GetIndex(), first);
+            output->TransformIndexToPhysicalPoint(region.GetUpperIndex(), last);
+            const fivox::Vector3f cutoff(loader->getCutOffDistance() +
+                                         output->GetSpacing()[0]);
+            const fivox::AABBf roi(
+                fivox::Vector3f(first[0], first[1], first[2]) - cutoff,
+                fivox::Vector3f(last[0], last[1], last[2]) + cutoff);
+            const size_t numEvents = loader->getNumEvents();
+            LBINFO << "Keeping " << loader->setRegionOfInterest(roi) << " of "
+                   << numEvents << " events in " << roi << std::endl;
+        }
         const fivox::Vector2ui frameRange(getFrameRange(loader->getDt()));
 
         if (_vm.count("export-events"))
@@ -194,6 +237,95 @@ public:
 private:
     std::string _outputFile;
     ::fivox::Vector2ui _decompose;
+
+    /**
+     * Restrict a decomposed job to the cells that may have events in its part
+     * of the volume or at the bounds of the whole volume, from their soma
+     * positions, before any morphology is loaded.
+     *
+     * The volume is only known once the events are loaded, but its bounding
+     * box is within the maximum cell extent of the one of the somas, which
+     * bounds the part of the volume of the job. All jobs keep the cells that
+     * may bound the volume, so they agree on it.
+     */
+    void _selectCells(::fivox::URIHandler& params) const
+    {
+        const float maxExtent = _vm["max-cell-extent"].as<float>();
+        const ::fivox::VolumeType type = params.getType();
+        if (maxExtent <= 0.f || !params.getReferenceVolume().empty() ||
+            (type != ::fivox::VolumeType::compartments &&
+             type != ::fivox::VolumeType::somas &&
+             type != ::fivox::VolumeType::vsd))
+        {
+            return;
+        }
+
+        const brion::GIDSet& gids = params.getGIDs();
+        const brain::Circuit circuit(params.getConfig());
+        const brion::Vector3fs& positions = circuit.getPositions(gids);
+        fivox::AABBf somas;
+        for (const auto& position : positions)
+            somas.merge(position);
+
+        // bounds of the size of the volume and of its voxels
+        const float extend = params.getExtendDistance();
+        fivox::Vector3f minSize, maxSize;
+        for (size_t i = 0; i < 3; ++i)
+        {
+            const float size = somas.getSize()[i] + 2.f * extend;
+            minSize[i] = std::max(size - 2.f * maxExtent, 0.f);
+            maxSize[i] = size + 2.f * maxExtent;
+        }
+        const float spacing =
+            params.getSizeInVoxel() > 0
+                ? maxSize.find_max() / float(params.getSizeInVoxel())
+                : 1.f / params.getResolution();
+
+        // the part is split along the largest dimension of the volume, its
+        // bounds move by at most maxExtent and one voxel with the volume, and
+        // it samples the events within the cutoff distance and one voxel
+        const float begin = float(_decompose[0]) / float(_decompose[1]);
+        const float end = float(_decompose[0] + 1) / float(_decompose[1]);
+        const float margin =
+            2.f * maxExtent + params.getCutoffDistance() + 2.f * spacing;
+        const auto isSelected = [&](const fivox::Vector3f& position) {
+            for (size_t i = 0; i < 3; ++i)
+            {
+                const float low = somas.getMin()[i];
+                const float high = somas.getMax()[i];
+                if (position[i] <= low + 2.f * maxExtent ||
+                    position[i] >= high - 2.f * maxExtent)
+                {
+                    return true; // may bound the volume
+                }
+
+                if (maxSize[i] < minSize.find_max())
+                    continue; // not the largest dimension
+                const float size = high - low + 2.f * extend;
+                if (position[i] >= low - extend + begin * size - margin &&
+                    position[i] <= low - extend + end * size + margin)
+                {
+                    return true;
+                }
+            }
+            return false;
+        };
+
+        brion::GIDSet selected;
+        auto gid = gids.begin();
+        for (const auto& position : positions)
+        {
+            if (isSelected(position))
+                selected.insert(selected.end(), *gid);
+            ++gid;
+        }
+
+        LBINFO << "Loading " << selected.size() << " of " << gids.size()
+               << " cells near part " << _decompose[0] << " of "
+               << _decompose[1] << std::endl;
+        if (selected.size() < gids.size())
+            params.setGIDs(selected);
+    }
 };
 
 int main(int argc, char* argv[])
@@ -0,0 +1,313 @@
+/* Copyright (c) 2017, EPFL/Blue Brain Project
+ *
+ * This file is part of Fivox <https://github.com/BlueBrain/Fivox>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef FIVOX_CACHE_H
+#define FIVOX_CACHE_H
+
+#include <fivox/types.h>
+#include <fivox/uriHandler.h>
+
+#include <lunchbox/log.h>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+
+namespace fivox
+{
+/** Helpers for the persistent caches of loaded data. */
+namespace cache
+{
+namespace detail
+{
+// FNV-1a, 64 bit
+const uint64_t fnvOffset = 0xcbf29ce484222325ull;
+const uint64_t fnvPrime = 0x100000001b3ull;
+
+inline bool makeDirectories(const std::string& path)
+{
+    for (size_t pos = path.find('/', 1);; pos = path.find('/', pos + 1))
+    {
+        const std::string& dir = path.substr(0, pos);
+        if (::mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST)
+            return false;
+        if (pos == std::string::npos)
+            return true;
+    }
+}
+
+/** @return the sorted names of the entries of a directory, without . and .. */
+inline std::vector<std::string> listDirectory(const std::string& path)
+{
+    std::vector<std::string> names;
+    DIR* dir = ::opendir(path.c_str());
+    if (!dir)
+        return names;
+    while (const dirent* entry = ::readdir(dir))
+    {
+        const std::string name(entry->d_name);
+        if (name != "." && name != "..")
+            names.push_back(name);
+    }
+    ::closedir(dir);
+    std::sort(names.begin(), names.end());
+    return names;
+}
+}
+
+/**
+ * Key of a cache file, a hash of all values identifying the cached data.
+ *
+ * The hash is stable across runs and machines, unlike std::hash.
+ */
+class Key
+{
+public:
+    Key()
+        : _hash(detail::fnvOffset)
+    {
+    }
+
+    Key& operator<<(const std::string& value)
+    {
+        *this << uint64_t(value.size());
+        _add(value.data(), value.size());
+        return *this;
+    }
+
+    Key& operator<<(const brion::GIDSet& gids)
+    {
+        *this << uint64_t(gids.size());
+        for (const uint32_t gid : gids)
+            _add(&gid, sizeof(gid));
+        return *this;
+    }
+
+    Key& operator<<(const uint64_t value)
+    {
+        _add(&value, sizeof(value));
+        return *this;
+    }
+
+    Key& operator<<(const float value)
+    {
+        _add(&value, sizeof(value));
+        return *this;
+    }
+
+    /** Add the values of a vector of trivially copyable elements */
+    template <typename T>
+    Key& operator<<(const std::vector<T>& values)
+    {
+        *this << uint64_t(values.size());
+        _add(values.data(), values.size() * sizeof(T));
+        return *this;
+    }
+
+    /**
+     * Add the path, size and modification time of a file, or of each file
+     * directly in a directory, so the key changes when the data is modified
+     * in place.
+     */
+    Key& addFile(const std::string& path)
+    {
+        struct stat info;
+        if (::stat(path.c_str(), &info) != 0)
+            return *this << path << uint64_t(0);
+
+        if (!S_ISDIR(info.st_mode))
+            return *this << path << uint64_t(info.st_size)
+                         << uint64_t(info.st_mtime);
+
+        // the files directly in the directory, e.g. the nrn*.h5 synapse files
+        *this << path;
+        for (const std::string& name : detail::listDirectory(path))
+        {
+            if (::stat((path + "/" + name).c_str(), &info) == 0 &&
+                S_ISREG(info.st_mode))
+            {
+                *this << name << uint64_t(info.st_size)
+                      << uint64_t(info.st_mtime);
+            }
+        }
+        return *this;
+    }
+
+    /** @return the hash as a hexadecimal string */
+    std::string getString() const
+    {
+        std::ostringstream os;
+        os << std::hex << std::setw(16) << std::setfill('0') << _hash;
+        return os.str();
+    }
+
+private:
+    void _add(const void* data, const size_t size)
+    {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; ++i)
+            _hash = (_hash ^ bytes[i]) * detail::fnvPrime;
+    }
+
+    uint64_t _hash;
+};
+
+/**
+ * @return the path of the cache file for the given name and key in the given
+ *         directory, or an empty string if the directory is empty or can't be
+ *         created.
+ */
+inline std::string getPath(const std::string& dir, const std::string& name,
+                           const Key& key)
+{
+    if (dir.empty())
+        return std::string();
+
+    if (!detail::makeDirectories(dir))
+    {
+        LBWARN << "Cannot create cache directory " << dir
+               << ", caching disabled: " << strerror(errno) << std::endl;
+        return std::string();
+    }
+    return dir + "/" + name + "-" + key.getString();
+}
+
+/**
+ * @return true if the given cache file exists, which is then marked as
+ *         recently used for trim().
+ */
+inline bool exists(const std::string& path)
+{
+    if (path.empty())
+        return false;
+
+    // the modification time orders the files by use for trim(), a read-only
+    // cache is used as is
+    struct stat info;
+    return ::utime(path.c_str(), nullptr) == 0 ||
+           ::stat(path.c_str(), &info) == 0;
+}
+
+/**
+ * Remove the least recently used cache files of a directory until the
+ * remaining ones use at most maxSize bytes.
+ *
+ * @param dir the cache directory.
+ * @param maxSize the maximum size in bytes of the remaining files.
+ * @param keep a cache file about to be used, not removed but counted.
+ */
+inline void trim(const std::string& dir, const uint64_t maxSize,
+                 const std::string& keep = std::string())
+{
+    struct File
+    {
+        time_t time;
+        std::string path;
+        uint64_t size;
+        bool operator<(const File& rhs) const
+        {
+            return time < rhs.time || (time == rhs.time && path < rhs.path);
+        }
+    };
+
+    // temporary files of unfinished writes have a '.' suffix and are kept
+    std::vector<File> files;
+    uint64_t size = 0;
+    for (const std::string& name : detail::listDirectory(dir))
+    {
+        struct stat info;
+        const std::string& path = dir + "/" + name;
+        if (name.find('.') != std::string::npos ||
+            ::stat(path.c_str(), &info) != 0 || !S_ISREG(info.st_mode))
+        {
+            continue;
+        }
+        files.push_back({info.st_mtime, path, uint64_t(info.st_size)});
+        size += info.st_size;
+    }
+
+    std::sort(files.begin(), files.end());
+    for (const File& file : files)
+    {
+        if (size <= maxSize)
+            break;
+        if (file.path == keep)
+            continue;
+        if (std::remove(file.path.c_str()) == 0)
+        {
+            LBINFO << "Removed cache file " << file.path << std::endl;
+            size -= file.size;
+        }
+    }
+}
+
+/**
+ * @return the path of the cache file for the given name and key, or an empty
+ *         string if caching is disabled or the cache directory can't be
+ *         created. Trims the cache directory to the cache size of the
+ *         parameters, keeping the returned file.
+ */
+inline std::string getPath(const URIHandler& params, const std::string& name,
+                           const Key& key)
+{
+    const std::string& path = getPath(params.getCacheDir(), name, key);
+    if (!path.empty())
+        trim(params.getCacheDir(), params.getCacheSize(), path);
+    return path;
+}
+
+/** A block of data in a cache file */
+typedef std::pair<const void*, size_t> Block;
+
+/**
+ * Write the given blocks of data to a cache file.
+ *
+ * The data is written to a temporary file first, which is renamed when
+ * complete, so concurrent readers never see a partial file.
+ *
+ * @return true if the file was written.
+ */
+inline bool write(const std::string& path, const std::vector<Block>& blocks)
+{
+    const std::string tmpPath = path + "." + std::to_string(::getpid());
+    std::ofstream file(tmpPath, std::ios::binary);
+    for (const Block& block : blocks)
+        file.write(static_cast<const char*>(block.first), block.second);
+    file.close();
+
+    if (file.good() && std::rename(tmpPath.c_str(), path.c_str()) == 0)
+        return true;
+
+    std::remove(tmpPath.c_str());
+    LBWARN << "Could not write cache file " << path << std::endl;
+    return false;
+}
+}
+}
+
+#endif
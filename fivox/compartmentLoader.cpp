@@ -42,32 +42,57 @@ class CompartmentLoader::Impl
 public:
     Impl(EventSource& output, const URIHandler& params)
         : _output(output)
-        , _report(params.getConfig().getReportSource(params.getReport()),
-                  brion::MODE_READ, params.getGIDs())
+        , _source(params.getConfig().getReportSource(params.getReport()))
+        , _report(_source, brion::MODE_READ, params.getGIDs())
+        , _mapping(helpers::computeInverseMapping(_report))
+        , _frames(_report)
     {
         const brain::Circuit circuit(params.getConfig());
-        const auto morphologies =
-            circuit.loadMorphologies(params.getGIDs(),
-                                     brain::Circuit::Coordinates::global);
+        helpers::addCompartmentEvents(params, circuit, _report, _mapping,
+                                      output);
+        if (!params.getGroupBy().empty())
+        {
+            brion::Strings names;
+            const brion::uint16_ts& groups =
+                helpers::computeCellGroups(circuit, _report.getGIDs(),
+                                           params.getGroupBy(), names);
+            helpers::addCompartmentGroups(groups, names, _mapping, output);
+        }
+    }
 
-        helpers::addCompartmentEvents(morphologies, _report, output);
+    void setRegionOfInterest(const AABBf& region)
+    {
+        auto regionReport = helpers::selectCellsInRegion(
+            region, _source, _regionReport ? *_regionReport : _report,
+            _mapping, _output);
+        if (!regionReport)
+            return;
+        _frames.setReport(*regionReport);
+        _regionReport = std::move(regionReport);
     }
 
     ssize_t load()
     {
-        const brion::floatsPtr values =
-            _report.loadFrame(_output.getCurrentTime()).get();
+        if (_output.getNumEvents() == 0)
+            return 0;
+
+        const brion::floatsPtr values = _frames.load(_output.getCurrentTime());
         if (!values)
             return -1;
 
-        for (size_t i = 0; i != values->size(); ++i)
-            _output[i] = (*values)[i];
+        _output.adoptValues(values);
 
         return values->size();
     }
 
     EventSource& _output;
+    const URI _source;
     brion::CompartmentReport _report;
+    // inverse mapping of the current report, the region report if any
+    helpers::FlatInverseMapping _mapping;
+    // report of the cells in the region of interest, if not all
+    std::unique_ptr<brion::CompartmentReport> _regionReport;
+    helpers::FrameReader<> _frames;
 };
 
 CompartmentLoader::CompartmentLoader(const URIHandler& params)
@@ -80,6 +105,7 @@ CompartmentLoader::CompartmentLoader(const URIHandler& params)
 
 CompartmentLoader::~CompartmentLoader()
 {
+    finishPrefetch();
 }
 
 Vector2f CompartmentLoader::_getTimeRange() const
@@ -87,6 +113,16 @@ Vector2f CompartmentLoader::_getTimeRange() const
     return Vector2f(_impl->_report.getStartTime(), _impl->_report.getEndTime());
 }
 
+void CompartmentLoader::_prefetch(const double time)
+{
+    _impl->_frames.prefetch(time);
+}
+
+void CompartmentLoader::_setRegionOfInterest(const AABBf& region)
+{
+    _impl->setRegionOfInterest(region);
+}
+
 ssize_t CompartmentLoader::_load(const size_t /*chunkIndex*/,
                                  const size_t /*numChunks*/)
 {
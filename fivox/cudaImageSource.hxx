@@ -35,6 +35,10 @@ CudaImageSource< TImage >::CudaImageSource()
 template< typename TImage >
 void CudaImageSource< TImage >::GenerateData()
 {
+    if( Superclass::getNumChannels() > 1 )
+        LBTHROW( std::runtime_error( "Event groups are not supported by "
+                                     "the CUDA image source" ));
+
     auto image = Superclass::GetOutput();
     image->Allocate();
     image->FillBuffer( 0 );
@@ -57,7 +61,8 @@ void CudaImageSource< TImage >::GenerateData()
     volInfo.origin.z = origin[2];
 
     auto source = Superclass::_eventSource;
-    source->load();
+    if( Superclass::_loadEvents )
+        source->load();
     const int fsize = source->getNumEvents() * sizeof(float);
 
     cuda::Parameters parameters;
@@ -25,6 +25,8 @@
 #include <fivox/api.h>
 #include <fivox/types.h>
 
+#include <algorithm>
+
 namespace fivox
 {
 /** Samples spatial events into the given voxel. */
@@ -44,6 +46,42 @@ public:
     FIVOX_API virtual TPixel operator()(const TPoint& point,
                                         const TSpacing& spacing) const = 0;
 
+    /** @return true if the functor can sample the events of each group */
+    FIVOX_API virtual bool supportsGroups() const { return false; }
+    /**
+     * Sample the events of each group into its own pixel, visiting each event
+     * once, see EventSource::getGroups(). Only called if supportsGroups()
+     * returns true.
+     *
+     * @param numGroups the number of pixels to sample, events of other groups
+     *        are ignored.
+     * @param pixels the sampled value of each group.
+     */
+    FIVOX_API virtual void sampleGroups(const TPoint& /*point*/,
+                                        const TSpacing& /*spacing*/,
+                                        const size_t numGroups,
+                                        TPixel* pixels) const
+    {
+        std::fill(pixels, pixels + numGroups, TPixel(0));
+    }
+
+    /** @return true if the functor samples a row of voxels at once */
+    FIVOX_API virtual bool supportsRows() const { return false; }
+    /**
+     * Sample a row of voxels along the x axis, starting at the given point
+     * with a distance of spacing[0] between the voxels.
+     *
+     * Functors override it to share work between the voxels of a row.
+     * @return false if not supported, the voxels are then sampled one by one.
+     */
+    FIVOX_API virtual bool sampleRow(const TPoint& /*first*/,
+                                     const TSpacing& /*spacing*/,
+                                     size_t /*count*/,
+                                     TPixel* /*pixels*/) const
+    {
+        return false;
+    }
+
 protected:
     EventSourcePtr _source;
 };
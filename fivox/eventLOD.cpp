@@ -0,0 +1,261 @@
+/* Copyright (c) 2017, EPFL/Blue Brain Project
+ *
+ * This file is part of Fivox <https://github.com/BlueBrain/Fivox>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "eventLOD.h"
+#include "eventSource.h"
+#include "uriHandler.h"
+
+#include <lunchbox/log.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <mutex>
+#include <unordered_map>
+
+namespace fivox
+{
+namespace
+{
+// merge a level only if it has at most half the events of the source
+const size_t minReduction = 2;
+// cells per dimension, 16 bit cell coordinates and group of a cell key
+const float maxCell = 65535.f;
+
+/** Merged events, set by EventLOD and not loaded */
+class MergedEvents : public EventSource
+{
+public:
+    explicit MergedEvents(const URIHandler& params)
+        : EventSource(params)
+    {
+    }
+    ~MergedEvents() { finishPrefetch(); }
+
+private:
+    Vector2f _getTimeRange() const final { return Vector2f(); }
+    ssize_t _load(size_t, size_t) final { return getNumEvents(); }
+    SourceType _getType() const final { return SourceType::frame; }
+    size_t _getNumChunks() const final { return 1; }
+};
+}
+
+class EventLOD::Impl
+{
+public:
+    Impl(const URIHandler& params_, EventSourcePtr source_,
+         const Vector3f& origin_, const float spacing_)
+        : params(params_)
+        , source(source_)
+        , origin(origin_)
+        , spacing(spacing_)
+        , maxValues(params.getFunctorType() == FunctorType::frequency)
+        , valuesVersion(1)
+    {
+    }
+
+    struct Level
+    {
+        Level()
+            : built(false)
+            , geometryVersion(0)
+            , valuesVersion(0)
+        {
+        }
+
+        bool built;
+        uint64_t geometryVersion; // of the source when built
+        uint64_t valuesVersion;   // of the merged values
+        EventSourcePtr events;    // nullptr if not merged
+        brion::uint32_ts cells;   // merged event of each source event
+    };
+
+    EventSourcePtr getLevel(const size_t index)
+    {
+        if (index == 0)
+            return source;
+
+        const std::lock_guard<std::mutex> lock(mutex);
+        if (levels.size() <= index)
+            levels.resize(index + 1);
+
+        Level& level = levels[index];
+        const uint64_t geometryVersion = source->getGeometryVersion();
+        if (!level.built || level.geometryVersion != geometryVersion)
+        {
+            build(level, index);
+            level.built = true;
+            level.geometryVersion = geometryVersion;
+            level.valuesVersion = 0;
+        }
+
+        if (!level.events)
+            return source;
+
+        if (level.valuesVersion != valuesVersion)
+        {
+            mergeValues(level);
+            level.valuesVersion = valuesVersion;
+        }
+        return level.events;
+    }
+
+    /** Assign the events to the cells of the level and merge the positions */
+    void build(Level& level, const size_t index)
+    {
+        const float cellSize = std::ldexp(spacing, int(index));
+        const float invCellSize = 1.f / cellSize;
+        const size_t numEvents = source->getNumEvents();
+        const float* posx = source->getPositionsX();
+        const float* posy = source->getPositionsY();
+        const float* posz = source->getPositionsZ();
+        const float* radii = source->getRadii();
+        const uint16_t* groups = source->getGroups();
+
+        // cell coordinate along an axis, cells centered on the voxels
+        const auto getCell = [&](const float position, const size_t axis) {
+            const float cell =
+                std::floor((position - origin[axis]) * invCellSize + .5f);
+            return uint64_t(std::min(std::max(cell, 0.f), maxCell));
+        };
+
+        std::unordered_map<uint64_t, uint32_t> cells;
+        std::vector<double> sumx, sumy, sumz;
+        brion::uint32_ts counts;
+        brion::floats cellRadii;
+        std::vector<uint16_t> cellGroups;
+
+        level.cells.resize(numEvents);
+        for (size_t i = 0; i < numEvents; ++i)
+        {
+            const uint16_t group = groups ? groups[i] : 0;
+            const uint64_t key = getCell(posx[i], 0) |
+                                 getCell(posy[i], 1) << 16 |
+                                 getCell(posz[i], 2) << 32 |
+                                 uint64_t(group) << 48;
+            const auto cell = cells.emplace(key, uint32_t(cells.size()));
+            const uint32_t j = cell.first->second;
+            if (cell.second)
+            {
+                sumx.push_back(0.);
+                sumy.push_back(0.);
+                sumz.push_back(0.);
+                counts.push_back(0);
+                cellRadii.push_back(cellSize * .5f);
+                cellGroups.push_back(group);
+            }
+
+            level.cells[i] = j;
+            sumx[j] += posx[i];
+            sumy[j] += posy[i];
+            sumz[j] += posz[i];
+            ++counts[j];
+            // radii are inverted in the event source
+            cellRadii[j] = std::max(cellRadii[j], 1.f / radii[i]);
+        }
+
+        const size_t numCells = cells.size();
+        if (numCells * minReduction > numEvents)
+        {
+            LBINFO << "Not merging " << numEvents << " events into "
+                   << numCells << " for level " << index << std::endl;
+            level.events.reset();
+            level.cells.clear();
+            return;
+        }
+
+        brion::floats x(numCells), y(numCells), z(numCells);
+        for (size_t j = 0; j < numCells; ++j)
+        {
+            x[j] = sumx[j] / counts[j];
+            y[j] = sumy[j] / counts[j];
+            z[j] = sumz[j] / counts[j];
+        }
+
+        EventSourcePtr events = std::make_shared<MergedEvents>(params);
+        events->resize(numCells);
+        events->setPositions(0, numCells, x.data(), y.data(), z.data());
+        events->setRadii(0, numCells, cellRadii.data());
+        if (groups)
+        {
+            events->setGroupNames(source->getGroupNames());
+            events->setGroups(0, numCells, cellGroups.data());
+        }
+        events->setBoundingBox(source->getBoundingBox());
+        level.events = events;
+
+        LBINFO << "Merged " << numEvents << " events into " << numCells
+               << " for level " << index << std::endl;
+    }
+
+    void mergeValues(Level& level)
+    {
+        const size_t numCells = level.events->getNumEvents();
+        const size_t numEvents = level.cells.size();
+        const float* values = source->getValues();
+
+        brion::floats merged(numCells, maxValues
+                                           ? -std::numeric_limits<float>::max()
+                                           : 0.f);
+        if (maxValues)
+        {
+            for (size_t i = 0; i < numEvents; ++i)
+            {
+                float& value = merged[level.cells[i]];
+                value = std::max(value, values[i]);
+            }
+        }
+        else
+        {
+            for (size_t i = 0; i < numEvents; ++i)
+                merged[level.cells[i]] += values[i];
+        }
+        level.events->setValues(0, numCells, merged.data());
+    }
+
+    const URIHandler& params;
+    const EventSourcePtr source;
+    const Vector3f origin;
+    const float spacing;
+    const bool maxValues;
+
+    std::mutex mutex;
+    std::vector<Level> levels;
+    uint64_t valuesVersion;
+};
+
+EventLOD::EventLOD(const URIHandler& params, EventSourcePtr source,
+                   const Vector3f& origin, const float spacing)
+    : _impl(new EventLOD::Impl(params, source, origin, spacing))
+{
+}
+
+EventLOD::~EventLOD()
+{
+}
+
+EventSourcePtr EventLOD::getLevel(const size_t level)
+{
+    return _impl->getLevel(level);
+}
+
+void EventLOD::invalidateValues()
+{
+    ++_impl->valuesVersion;
+}
+}
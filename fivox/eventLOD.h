@@ -0,0 +1,83 @@
+/* Copyright (c) 2017, EPFL/Blue Brain Project
+ *
+ * This file is part of Fivox <https://github.com/BlueBrain/Fivox>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef FIVOX_EVENTLOD_H
+#define FIVOX_EVENTLOD_H
+
+#include <fivox/api.h>
+#include <fivox/types.h>
+
+namespace fivox
+{
+/**
+ * Levels of detail of an event source for sampling coarse volumes.
+ *
+ * Level n merges the events within each cell of a regular grid with a cell
+ * size of 2^n times the size of the voxels of the finest volume, so a volume
+ * with that spacing samples about one event per voxel instead of all of them.
+ * The cells are centered on the voxels, so the merged events of a voxel stay
+ * in the voxel.
+ *
+ * A merged event is placed at the center of its events and has the sum of
+ * their values, or the maximum for the frequency functor. Its radius is at
+ * least half the cell size. Events of different groups are not merged.
+ */
+class EventLOD
+{
+public:
+    /**
+     * @param params the parameters of the merged event sources, e.g. the
+     *        cutoff distance, and the functor type selecting how the values
+     *        are merged. Must outlive the EventLOD.
+     * @param source the events to merge.
+     * @param origin the center of a voxel of the finest volume.
+     * @param spacing the size of the voxels of the finest volume.
+     */
+    FIVOX_API EventLOD(const URIHandler& params, EventSourcePtr source,
+                       const Vector3f& origin, float spacing);
+    FIVOX_API ~EventLOD();
+
+    /**
+     * Get the merged events of a level.
+     *
+     * The merged positions are updated if the geometry of the source changed,
+     * the merged values after each invalidateValues(). Thread safe, but not
+     * with updates of the source.
+     *
+     * @param level the level of detail, 0 for the finest volume.
+     * @return the merged events of the given level, or the source for level 0
+     *         or if merging does not reduce the number of events enough.
+     */
+    FIVOX_API EventSourcePtr getLevel(size_t level);
+
+    /**
+     * Merge the values again on the next getLevel(), e.g. after loading a new
+     * frame into the source. Not thread safe with getLevel().
+     */
+    FIVOX_API void invalidateValues();
+
+private:
+    EventLOD(const EventLOD&) = delete;
+    EventLOD& operator=(const EventLOD&) = delete;
+
+    class Impl;
+    std::unique_ptr<Impl> _impl;
+};
+}
+
+#endif
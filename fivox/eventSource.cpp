@@ -27,15 +27,18 @@
 #include <lunchbox/debug.h>
 #include <lunchbox/log.h>
 #include <lunchbox/memoryMap.h>
+#include <lunchbox/scopedMutex.h>
 
+#include <atomic>
 #include <fstream>
+#include <future>
+#include <thread>
 
 #ifdef USE_BOOST_GEOMETRY
 #include <boost/geometry.hpp>
 #include <boost/geometry/geometries/box.hpp>
 #include <boost/geometry/geometries/point.hpp>
 #include <boost/geometry/index/rtree.hpp>
-#include <lunchbox/scopedMutex.h>
 
 namespace bg = boost::geometry;
 namespace bgi = boost::geometry::index;
@@ -53,11 +56,46 @@ const size_t maxElemInNode = 64;
 const size_t minElemInNode = 16;
 const uint32_t magic = 0xfebf;
 const uint32_t version = 1;
+const size_t minEventsPerThread = 65536;
+const size_t minValueAlignment = 16;
+const size_t maxGroups = 65536;
+const size_t minSparseRatio = 8; // events per active event for a sparse rtree
+
+// the source loaded by the current thread in EventSource::prefetch()
+thread_local const void* loadingSource = nullptr;
+
+// geometry versions are unique across all event sources, so a new source
+// allocated at the address of a destroyed one never has one of its versions
+std::atomic<uint64_t> nextGeometryVersion(1);
 
 size_t _getBinarySize(const size_t numEvents)
 {
     return numEvents * 5 * sizeof(float) + sizeof(magic) + sizeof(version);
 }
+
+size_t _getNumThreads(const size_t numEvents)
+{
+    const size_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    return std::max(size_t(1),
+                    std::min(maxThreads, numEvents / minEventsPerThread));
+}
+
+fivox::AABBf _copyPositions(float* __restrict__ posx, float* __restrict__ posy,
+                            float* __restrict__ posz,
+                            const float* __restrict__ x,
+                            const float* __restrict__ y,
+                            const float* __restrict__ z, const size_t count)
+{
+    fivox::AABBf bbox;
+    for (size_t i = 0; i < count; ++i)
+    {
+        posx[i] = x[i];
+        posy[i] = y[i];
+        posz[i] = z[i];
+        bbox.merge(fivox::Vector3f(x[i], y[i], z[i]));
+    }
+    return bbox;
+}
 }
 
 namespace fivox
@@ -75,25 +113,143 @@ public:
         NUM_OFFSETS
     };
 
+    /**
+     * One buffer of the event arena. The allocation is kept across resizes
+     * so chunked sources do not reallocate for every batch.
+     */
+    struct Buffer
+    {
+        Buffer()
+            : numEvents(0)
+            , allocSize(0)
+            , hasActive(false)
+        {
+        }
+
+        float* get(const EventOffsets attribute) const
+        {
+            return events.get() + numEvents * attribute;
+        }
+
+        const float* getValues() const
+        {
+            return adoptedValues ? adoptedValues->data() : get(VALUE);
+        }
+
+        /** @return the writable values, copying adopted values first */
+        float* writeValues()
+        {
+            hasActive = false;
+            if (adoptedValues)
+            {
+                std::copy(adoptedValues->begin(),
+                          adoptedValues->begin() + numEvents, get(VALUE));
+                adoptedValues.reset();
+            }
+            return get(VALUE);
+        }
+
+        Events events;
+        size_t numEvents;
+        size_t allocSize;
+        brion::floatsPtr adoptedValues; // used instead of VALUE if set
+        brion::uint16_ts groups;        // empty if the events are not grouped
+        brion::uint32_ts active; // events with nonzero values, if hasActive
+        bool hasActive;
+        AABBf boundingBox;
+    };
+
     explicit Impl(const URIHandler& params)
         : dt(params.getDt())
         , duration(params.getDuration())
         , currentTime(-1.)
         , cutOffDistance(params.getCutoffDistance())
         , alignBoundary(32)
-        , numEvents(0)
-        , allocSize(0)
+        , readIndex(0)
+        , writeIndex(0)
+        , prefetchChunk(0)
+        , prefetchNumChunks(0)
+        , prefetchTime(0.)
+        , positionsChanged(false)
+        , geometryVersion(nextGeometryVersion++)
+        , versionPending(false)
+        , activeChanged(false)
+        , sparseRTree(false)
     {
     }
 
+    /** @return true in the thread loading the back buffer in prefetch */
+    bool isLoading() const { return loadingSource == this; }
+
+    /**
+     * @return the buffer read by the getters and functors, the back buffer
+     *         for the loader running in prefetch
+     */
+    const Buffer& readBuffer() const
+    {
+        return buffers[isLoading() ? writeIndex : readIndex];
+    }
+    /** @return the buffer filled by loaders, the back buffer in prefetch */
+    Buffer& writeBuffer() { return buffers[writeIndex]; }
+
+    /**
+     * Invalidate the state derived from the front buffer. Changes of the back
+     * buffer in prefetch invalidate it when load() swaps the buffers.
+     */
+    void geometryChanged()
+    {
+        if (isLoading())
+            return;
+        positionsChanged = true;
+        geometryVersion = nextGeometryVersion++;
+    }
+
+    /**
+     * Invalidate the state derived from the front buffer after a change of a
+     * single event. Only marks the change, the version is updated once by the
+     * next getGeometryVersion() instead of for every event.
+     */
+    void eventChanged()
+    {
+        if (isLoading())
+            return;
+        positionsChanged.store(true, std::memory_order_relaxed);
+        versionPending.store(true, std::memory_order_relaxed);
+    }
+
+    uint64_t getGeometryVersion()
+    {
+        if (versionPending.load(std::memory_order_acquire))
+        {
+            const std::lock_guard<std::mutex> guard(lock);
+            if (versionPending.load(std::memory_order_relaxed))
+            {
+                geometryVersion = nextGeometryVersion++;
+                versionPending.store(false, std::memory_order_release);
+            }
+        }
+        return geometryVersion;
+    }
     void resize(const size_t numEvents_)
     {
-        numEvents = numEvents_;
-        if (numEvents_ < allocSize)
+        Buffer& buffer = writeBuffer();
+        buffer.numEvents = numEvents_;
+        buffer.adoptedValues.reset();
+        buffer.hasActive = false;
+        buffer.groups.resize(groupNames.empty() ? 0 : numEvents_);
+        if (numEvents_ <= buffer.allocSize)
             return;
 
-        allocSize = numEvents_;
-        const size_t size = numEvents * EventOffsets::NUM_OFFSETS;
+        // grow geometrically to amortize varying batch sizes
+        buffer.allocSize =
+            std::max(numEvents_, buffer.allocSize + buffer.allocSize / 2);
+        buffer.events = allocate(buffer.allocSize);
+    }
+
+    /** @return an aligned allocation for the given number of events */
+    Events allocate(const size_t numEvents_) const
+    {
+        const size_t size = numEvents_ * EventOffsets::NUM_OFFSETS;
         void* ptr;
         if (posix_memalign(&ptr, alignBoundary, size * sizeof(float)))
         {
@@ -103,7 +259,45 @@ public:
             if (!ptr)
                 LBTHROW(std::bad_alloc());
         }
-        events.reset((float*)ptr);
+        return Events((float*)ptr);
+    }
+
+    void selectEvents(const brion::size_ts& indices)
+    {
+        Buffer& buffer = writeBuffer();
+        for (const size_t index : indices)
+            if (index >= buffer.numEvents)
+                LBTHROW(std::out_of_range("EventSource: event " +
+                                          std::to_string(index) +
+                                          " out of range"));
+
+        const size_t size = indices.size();
+        Buffer selected;
+        selected.boundingBox = buffer.boundingBox;
+        selected.numEvents = size;
+        selected.allocSize = size;
+        selected.events = allocate(size);
+        for (size_t attribute = POSX; attribute < NUM_OFFSETS; ++attribute)
+        {
+            const EventOffsets offset = EventOffsets(attribute);
+            const float* src =
+                offset == VALUE ? buffer.getValues() : buffer.get(offset);
+            float* dst = selected.get(offset);
+            for (size_t i = 0; i < size; ++i)
+                dst[i] = src[indices[i]];
+        }
+        if (!buffer.groups.empty())
+        {
+            selected.groups.resize(size);
+            for (size_t i = 0; i < size; ++i)
+                selected.groups[i] = buffer.groups[indices[i]];
+        }
+
+        buffer = std::move(selected);
+        positionsChanged = true;
+#ifdef USE_BOOST_GEOMETRY
+        rtree.clear();
+#endif
     }
 
     bool readAscii(const std::string& filename)
@@ -127,6 +321,7 @@ public:
                 continue;
             }
 
+            const size_t numEvents = writeBuffer().numEvents;
             if (numEvents == 0)
             {
                 LBWARN << "No events to load. Please check that the number "
@@ -155,7 +350,8 @@ public:
                    event[4]);
         }
         file.close();
-        LBINFO << "Loaded " << numEvents << " events from ASCII file "
+        LBINFO << "Loaded " << writeBuffer().numEvents
+               << " events from ASCII file "
                << filename << std::endl;
 
         return file.good();
@@ -203,15 +399,19 @@ public:
         }
 
         resize(numEvents_);
+        brion::floats posx(numEvents_), posy(numEvents_), posz(numEvents_);
+        brion::floats radii(numEvents_), values(numEvents_);
         for (size_t i = 0; i < numEvents_; ++i)
         {
-            const Vector3f pos(fData[index], fData[index + 1],
-                               fData[index + 2]);
-            index += 3;
-            const float radius(fData[index++]);
-            const float value(fData[index++]);
-            update(i, pos, radius, value);
+            posx[i] = fData[index++];
+            posy[i] = fData[index++];
+            posz[i] = fData[index++];
+            radii[i] = fData[index++];
+            values[i] = fData[index++];
         }
+        setPositions(0, numEvents_, posx.data(), posy.data(), posz.data());
+        setRadii(0, numEvents_, radii.data());
+        setValues(0, numEvents_, values.data());
 
         LBINFO << "Loaded " << numEvents_ << " events from binary file "
                << filename << std::endl;
@@ -220,79 +420,367 @@ public:
 
     const float* getPositionsX() const
     {
-        return events.get() + numEvents * EventOffsets::POSX;
+        return readBuffer().get(EventOffsets::POSX);
     }
 
     const float* getPositionsY() const
     {
-        return events.get() + numEvents * EventOffsets::POSY;
+        return readBuffer().get(EventOffsets::POSY);
     }
 
     const float* getPositionsZ() const
     {
-        return events.get() + numEvents * EventOffsets::POSZ;
+        return readBuffer().get(EventOffsets::POSZ);
     }
 
     const float* getRadii() const
     {
-        return events.get() + numEvents * EventOffsets::RADIUS;
+        return readBuffer().get(EventOffsets::RADIUS);
     }
 
     const float* getValues() const
     {
-        return events.get() + numEvents * EventOffsets::VALUE;
+        return readBuffer().getValues();
     }
 
     void update(const size_t i, const Vector3f& pos, const float rad,
                 const float val)
     {
-        const size_t size(numEvents);
-        if (size <= i)
+        Buffer& buffer = writeBuffer();
+        if (buffer.numEvents <= i)
         {
             LBWARN << "The specified index is not valid. Event not added"
                    << std::endl;
             return;
         }
 
-        boundingBox.merge(pos);
-        events.get()[i + size * Impl::EventOffsets::POSX] = pos[0];
-        events.get()[i + size * Impl::EventOffsets::POSY] = pos[1];
-        events.get()[i + size * Impl::EventOffsets::POSZ] = pos[2];
+        buffer.boundingBox.merge(pos);
+        buffer.get(EventOffsets::POSX)[i] = pos[0];
+        buffer.get(EventOffsets::POSY)[i] = pos[1];
+        buffer.get(EventOffsets::POSZ)[i] = pos[2];
 
         // radius is inverted to improve performance at computing time
         // e.g. LFP functor
         if (std::abs(rad) > std::numeric_limits<float>::epsilon()) // rad != 0
-            events.get()[i + size * Impl::EventOffsets::RADIUS] = 1.f / rad;
+            buffer.get(EventOffsets::RADIUS)[i] = 1.f / rad;
 
-        events.get()[i + size * Impl::EventOffsets::VALUE] = val;
+        buffer.writeValues()[i] = val;
 
 #ifdef USE_BOOST_GEOMETRY
-        rtree.clear();
+        // the rtree indexes the front buffer
+        if (!isLoading())
+            rtree.clear();
 #endif
     }
 
+    void checkRange(const size_t offset, const size_t count)
+    {
+        if (offset + count > writeBuffer().numEvents)
+            LBTHROW(std::out_of_range("EventSource: events [" +
+                                      std::to_string(offset) + ", " +
+                                      std::to_string(offset + count) +
+                                      ") out of range"));
+    }
+
+    float* getEvents(const EventOffsets attribute, const size_t offset)
+    {
+        return writeBuffer().get(attribute) + offset;
+    }
+
+    void setPositions(const size_t offset, const size_t count,
+                      const float* x, const float* y, const float* z)
+    {
+        checkRange(offset, count);
+        float* posx = getEvents(EventOffsets::POSX, offset);
+        float* posy = getEvents(EventOffsets::POSY, offset);
+        float* posz = getEvents(EventOffsets::POSZ, offset);
+
+        AABBf bbox;
+        const size_t numThreads = _getNumThreads(count);
+        if (numThreads == 1)
+            bbox = _copyPositions(posx, posy, posz, x, y, z, count);
+        else
+        {
+            // copy and reduce the bounding box of each range in parallel
+            const size_t step = (count + numThreads - 1) / numThreads;
+            std::vector<std::future<AABBf>> bboxes;
+            for (size_t begin = 0; begin < count; begin += step)
+            {
+                const size_t size = std::min(step, count - begin);
+                bboxes.push_back(std::async(std::launch::async, [=] {
+                    return _copyPositions(posx + begin, posy + begin,
+                                          posz + begin, x + begin, y + begin,
+                                          z + begin, size);
+                }));
+            }
+            for (auto& future : bboxes)
+                bbox.merge(future.get());
+        }
+
+        lunchbox::ScopedWrite mutex(lock);
+        writeBuffer().boundingBox.merge(bbox);
+    }
+
+    void setRadii(const size_t offset, const size_t count, const float* radii)
+    {
+        checkRange(offset, count);
+        float* dst = getEvents(EventOffsets::RADIUS, offset);
+        for (size_t i = 0; i < count; ++i)
+            dst[i] = _invert(radii[i]);
+    }
+
+    void setRadii(const size_t offset, const size_t count, const float radius)
+    {
+        checkRange(offset, count);
+        float* dst = getEvents(EventOffsets::RADIUS, offset);
+        std::fill(dst, dst + count, _invert(radius));
+    }
+
+    void setValues(const size_t offset, const size_t count,
+                   const float* values)
+    {
+        checkRange(offset, count);
+        std::copy(values, values + count, writeBuffer().writeValues() + offset);
+    }
+
+    void setValues(const size_t offset, const size_t count, const float value)
+    {
+        checkRange(offset, count);
+        float* dst = writeBuffer().writeValues() + offset;
+        std::fill(dst, dst + count, value);
+    }
+
+    bool adoptValues(const brion::floatsPtr& values)
+    {
+        Buffer& buffer = writeBuffer();
+        if (!values || values->size() != buffer.numEvents)
+            LBTHROW(std::out_of_range(
+                "EventSource: adopted values do not match the number of "
+                "events"));
+
+        // functors use aligned SIMD loads, fall back to a copy for buffers
+        // not aligned to at least 16 bytes
+        if (reinterpret_cast<uintptr_t>(values->data()) % minValueAlignment)
+        {
+            // all values are replaced, do not copy the adopted ones first
+            buffer.adoptedValues.reset();
+            setValues(0, values->size(), values->data());
+            return false;
+        }
+        buffer.adoptedValues = values;
+        buffer.hasActive = false;
+        return true;
+    }
+
+    void setSparseValues(const brion::uint32_ts& indices, const float* values)
+    {
+        Buffer& buffer = writeBuffer();
+        for (const uint32_t index : indices)
+            if (index >= buffer.numEvents)
+                LBTHROW(std::out_of_range("EventSource: event " +
+                                          std::to_string(index) +
+                                          " out of range"));
+
+        // reset the previous active events, all events if they are unknown
+        const bool hadActive = buffer.hasActive;
+        float* dst = buffer.writeValues();
+        if (hadActive)
+        {
+            for (const uint32_t index : buffer.active)
+                dst[index] = 0.f;
+        }
+        else
+            std::fill(dst, dst + buffer.numEvents, 0.f);
+
+        for (size_t i = 0; i < indices.size(); ++i)
+            dst[indices[i]] = values[i];
+        buffer.active = indices;
+        buffer.hasActive = true;
+        activeChanged = true;
+    }
+
+    void setGroupNames(const brion::Strings& names)
+    {
+        if (names.size() > maxGroups)
+            LBTHROW(std::out_of_range("EventSource: " +
+                                      std::to_string(names.size()) +
+                                      " groups, at most " +
+                                      std::to_string(maxGroups) + " allowed"));
+        groupNames = names;
+        for (Buffer& buffer : buffers)
+            buffer.groups.resize(names.empty() ? 0 : buffer.numEvents);
+    }
+
+    uint16_t* getGroups(const size_t offset, const size_t count)
+    {
+        checkRange(offset, count);
+        if (groupNames.empty())
+            LBTHROW(std::out_of_range("EventSource: events are not grouped"));
+        return writeBuffer().groups.data() + offset;
+    }
+
+    void checkGroup(const uint16_t group) const
+    {
+        if (group >= groupNames.size())
+            LBTHROW(std::out_of_range("EventSource: group " +
+                                      std::to_string(group) +
+                                      " out of range"));
+    }
+
+    void setGroups(const size_t offset, const size_t count,
+                   const uint16_t* groups)
+    {
+        uint16_t* dst = getGroups(offset, count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            checkGroup(groups[i]);
+            dst[i] = groups[i];
+        }
+    }
+
+    void setGroups(const size_t offset, const size_t count,
+                   const uint16_t group)
+    {
+        uint16_t* dst = getGroups(offset, count);
+        checkGroup(group);
+        std::fill(dst, dst + count, group);
+    }
+
+    // radius is inverted to improve performance at computing time, 0 if the
+    // radius is 0
+    static float _invert(const float radius)
+    {
+        return std::abs(radius) > std::numeric_limits<float>::epsilon()
+                   ? 1.f / radius
+                   : 0.f;
+    }
+
     double dt;
     double duration;
     double currentTime;
     const float cutOffDistance;
 
     const size_t alignBoundary;
-    size_t numEvents;
-    size_t allocSize;
-    Events events;
-    AABBf boundingBox;
+    Buffer buffers[2];
+    size_t readIndex;
+    size_t writeIndex;
+
+    // pending prefetch() into the back buffer
+    std::future<ssize_t> prefetched;
+    size_t prefetchChunk;
+    size_t prefetchNumChunks;
+    double prefetchTime;
+
+    brion::Strings groupNames;
+
+    std::mutex lock; // protects the boundingBox of buffers in bulk updates
+                     // and the version of versionPending
+    std::mutex rtreeLock; // serializes buildRTree()
+    std::atomic<bool> positionsChanged; // since the last buildRTree()
+    std::atomic<uint64_t> geometryVersion;
+    std::atomic<bool> versionPending; // events changed by update()
+    bool activeChanged; // since the last buildRTree()
+    bool sparseRTree;   // rtree of the active events only
 
 #ifdef USE_BOOST_GEOMETRY
     typedef bgi::rtree<Value, bgi::rstar<maxElemInNode, minElemInNode>> RTree;
     RTree rtree;
+#endif
+
+    /** @return the indices of the events in the area */
+    brion::uint32_ts findEventIndices(const AABBf& area LB_UNUSED) const
+    {
+        brion::uint32_ts indices;
+#ifdef USE_BOOST_GEOMETRY
+        if (!rtree.empty() || sparseRTree)
+        {
+            const Vector3f& p1 = area.getMin();
+            const Vector3f& p2 = area.getMax();
+            const Box query(Point(p1[0], p1[1], p1[2]),
+                            Point(p2[0], p2[1], p2[2]));
+
+            static lunchbox::a_ssize_t maxHits(0);
+            std::vector<Value> hits;
+            hits.reserve(maxHits);
+            rtree.query(bgi::intersects(query), std::back_inserter(hits));
+            maxHits = std::max(size_t(maxHits), hits.size());
+
+            indices.reserve(hits.size());
+            for (const Value& value : hits)
+                indices.push_back(uint32_t(value.second));
+        }
+        else
+#endif
+        // return empty
+        {
+            static bool first = true;
+            if (first)
+            {
+                LBWARN << "RTree not available for findEvents. "
+                       << "No events will be returned" << std::endl;
+                first = false;
+            }
+        }
+        return indices;
+    }
+
+    /**
+     * @return the values of the events in the area, only of the given group
+     *         if groups is not nullptr
+     */
+    EventValues findEvents(const AABBf& area, const uint16_t* groups,
+                           const size_t group) const
+    {
+        const brion::uint32_ts& indices = findEventIndices(area);
+        const float* values = getValues();
+
+        EventValues eventValues;
+        eventValues.reserve(indices.size());
+        for (const uint32_t index : indices)
+        {
+            if (!groups || groups[index] == group)
+                eventValues.push_back(values[index]);
+        }
+        return eventValues;
+    }
 
+#ifdef USE_BOOST_GEOMETRY
     void buildRTree()
     {
-        if (!rtree.empty())
+        // image sources sharing this source build the rtree concurrently
+        lunchbox::ScopedWrite mutex(rtreeLock);
+
+        // index only the events with nonzero values if they are known and
+        // few, e.g. the spiking neurons of a time window
+        const Buffer& buffer = readBuffer();
+        const bool sparse = buffer.hasActive &&
+                            buffer.active.size() * minSparseRatio <
+                                buffer.numEvents;
+        if (sparse == sparseRTree && !positionsChanged &&
+            (sparse ? !activeChanged : !rtree.empty()))
+        {
             return;
+        }
+        positionsChanged = false;
+        activeChanged = false;
+        sparseRTree = sparse;
 
-        LBINFO << "Building rtree for " << numEvents << " events" << std::endl;
         Values positions;
+        if (sparse)
+        {
+            positions.reserve(buffer.active.size());
+            for (const uint32_t i : buffer.active)
+            {
+                const Point point(getPositionsX()[i], getPositionsY()[i],
+                                  getPositionsZ()[i]);
+                positions.push_back(std::make_pair(point, i));
+            }
+            rtree = RTree(positions.begin(), positions.end());
+            return;
+        }
+
+        const size_t numEvents = buffer.numEvents;
+        LBINFO << "Building rtree for " << numEvents << " events" << std::endl;
         positions.reserve(numEvents);
 
         for (size_t i = 0; i < numEvents; i++)
@@ -316,17 +804,20 @@ EventSource::EventSource(const URIHandler& params)
 
 EventSource::~EventSource()
 {
+    // a pending prefetch may still call _load() of the destroyed derived class
+    LBASSERTINFO(!_impl->prefetched.valid(),
+                 "Derived event sources must call finishPrefetch() in their "
+                 "destructor");
 }
 
 float& EventSource::operator[](const size_t index)
 {
-    return _impl->events
-        .get()[_impl->numEvents * Impl::EventOffsets::VALUE + index];
+    return _impl->writeBuffer().writeValues()[index];
 }
 
 size_t EventSource::getNumEvents() const
 {
-    return _impl->numEvents;
+    return _impl->readBuffer().numEvents;
 }
 
 const float* EventSource::getPositionsX() const
@@ -354,49 +845,29 @@ const float* EventSource::getValues() const
     return _impl->getValues();
 }
 
-EventValues EventSource::findEvents(const AABBf& area LB_UNUSED) const
+EventValues EventSource::findEvents(const AABBf& area) const
 {
-    EventValues eventValues;
-#ifdef USE_BOOST_GEOMETRY
-    if (!_impl->rtree.empty())
-    {
-        const Vector3f& p1 = area.getMin();
-        const Vector3f& p2 = area.getMax();
-        const Box query(Point(p1[0], p1[1], p1[2]), Point(p2[0], p2[1], p2[2]));
+    return _impl->findEvents(area, nullptr, 0);
+}
 
-        static lunchbox::a_ssize_t maxHits(0);
-        std::vector<Value> hits;
-        hits.reserve(maxHits);
-        _impl->rtree.query(bgi::intersects(query), std::back_inserter(hits));
-        maxHits = std::max(size_t(maxHits), hits.size());
+EventValues EventSource::findEvents(const AABBf& area, const size_t group) const
+{
+    return _impl->findEvents(area, getGroups(), group);
+}
 
-        eventValues.reserve(hits.size());
-        for (const Value& value : hits)
-            eventValues.push_back(getValues()[value.second]);
-    }
-    else
-#endif
-    // return empty
-    {
-        static bool first = true;
-        if (first)
-        {
-            LBWARN << "RTree not available for findEvents. "
-                   << "No events will be returned" << std::endl;
-            first = false;
-        }
-    }
-    return eventValues;
+brion::uint32_ts EventSource::findEventIndices(const AABBf& area) const
+{
+    return _impl->findEventIndices(area);
 }
 
 void EventSource::setBoundingBox(const AABBf& boundingBox)
 {
-    _impl->boundingBox = boundingBox;
+    _impl->writeBuffer().boundingBox = boundingBox;
 }
 
 const AABBf& EventSource::getBoundingBox() const
 {
-    return _impl->boundingBox;
+    return _impl->readBuffer().boundingBox;
 }
 
 float EventSource::getCutOffDistance() const
@@ -406,13 +877,133 @@ float EventSource::getCutOffDistance() const
 
 void EventSource::resize(const size_t size)
 {
+    if (size != _impl->writeBuffer().numEvents)
+        _impl->geometryChanged();
     _impl->resize(size);
 }
 
+void EventSource::selectEvents(const brion::size_ts& indices)
+{
+    _impl->selectEvents(indices);
+    _impl->geometryChanged();
+}
+
+size_t EventSource::setRegionOfInterest(const AABBf& region)
+{
+    finishPrefetch();
+    _setRegionOfInterest(region);
+    return getNumEvents();
+}
+
 void EventSource::update(const size_t i, const Vector3f& pos, const float rad,
                          const float val)
 {
     _impl->update(i, pos, rad, val);
+    _impl->eventChanged();
+}
+
+void EventSource::setPositions(const size_t offset, const size_t count,
+                               const float* x, const float* y, const float* z)
+{
+    _impl->setPositions(offset, count, x, y, z);
+    _impl->geometryChanged();
+}
+
+void EventSource::setPositions(const size_t offset,
+                               const brion::Vector3fs& positions)
+{
+    const size_t count = positions.size();
+    brion::floats x(count), y(count), z(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        x[i] = positions[i][0];
+        y[i] = positions[i][1];
+        z[i] = positions[i][2];
+    }
+    _impl->setPositions(offset, count, x.data(), y.data(), z.data());
+    _impl->geometryChanged();
+}
+
+void EventSource::setRadii(const size_t offset, const size_t count,
+                           const float* radii)
+{
+    _impl->setRadii(offset, count, radii);
+}
+
+void EventSource::setRadii(const size_t offset, const size_t count,
+                           const float radius)
+{
+    _impl->setRadii(offset, count, radius);
+}
+
+void EventSource::setValues(const size_t offset, const size_t count,
+                            const float* values)
+{
+    _impl->setValues(offset, count, values);
+}
+
+void EventSource::setValues(const size_t offset, const size_t count,
+                            const float value)
+{
+    _impl->setValues(offset, count, value);
+}
+
+void EventSource::setSparseValues(const brion::uint32_ts& indices,
+                                  const float* values)
+{
+    _impl->setSparseValues(indices, values);
+}
+
+const brion::uint32_ts* EventSource::getActiveEvents() const
+{
+    const Impl::Buffer& buffer = _impl->readBuffer();
+    return buffer.hasActive ? &buffer.active : nullptr;
+}
+
+bool EventSource::adoptValues(const brion::floatsPtr& values)
+{
+    return _impl->adoptValues(values);
+}
+
+void EventSource::setGroupNames(const brion::Strings& names)
+{
+    _impl->setGroupNames(names);
+    _impl->geometryChanged();
+}
+
+const brion::Strings& EventSource::getGroupNames() const
+{
+    return _impl->groupNames;
+}
+
+size_t EventSource::getNumGroups() const
+{
+    return _impl->groupNames.size();
+}
+
+const uint16_t* EventSource::getGroups() const
+{
+    const brion::uint16_ts& groups = _impl->readBuffer().groups;
+    return groups.empty() ? nullptr : groups.data();
+}
+
+void EventSource::setGroups(const size_t offset, const size_t count,
+                            const uint16_t* groups)
+{
+    _impl->setGroups(offset, count, groups);
+    _impl->geometryChanged();
+}
+
+void EventSource::setGroups(const size_t offset, const size_t count,
+                            const uint16_t group)
+{
+    _impl->setGroups(offset, count, group);
+    _impl->geometryChanged();
+}
+
+uint64_t EventSource::getGeometryVersion() const
+{
+    return _impl->getGeometryVersion();
 }
 
 void EventSource::buildRTree()
@@ -437,6 +1028,20 @@ void EventSource::setTime(const double time)
     _impl->currentTime = time;
 }
 
+void EventSource::prefetch(const double time)
+{
+    _prefetch(time);
+}
+
+bool EventSource::prefetchFrame(const uint32_t frame)
+{
+    if (!isInFrameRange(frame))
+        return false;
+
+    prefetch(_getTimeRange().x() + getDt() * frame);
+    return true;
+}
+
 Vector2ui EventSource::getFrameRange() const
 {
     const Vector2f& interval = _getTimeRange();
@@ -483,7 +1088,8 @@ double EventSource::getDuration() const
 
 double EventSource::getCurrentTime() const
 {
-    return _impl->currentTime;
+    // the time of the frame loaded into the back buffer in prefetch
+    return _impl->isLoading() ? _impl->prefetchTime : _impl->currentTime;
 }
 
 ssize_t EventSource::load(const size_t chunkIndex, const size_t numChunks)
@@ -492,9 +1098,80 @@ ssize_t EventSource::load(const size_t chunkIndex, const size_t numChunks)
         LBTHROW(std::runtime_error("EventSource::load: numChunks must be > 0"));
     if (chunkIndex + numChunks > getNumChunks())
         LBTHROW(std::out_of_range("EventSource::load: Out of range"));
+
+    if (_impl->prefetched.valid())
+    {
+        if (chunkIndex != _impl->prefetchChunk ||
+            numChunks != _impl->prefetchNumChunks ||
+            getCurrentTime() != _impl->prefetchTime)
+        {
+            // prefetched the wrong chunks, discard them and their errors
+            finishPrefetch();
+            return _load(chunkIndex, numChunks);
+        }
+
+        ssize_t result;
+        try
+        {
+            result = _impl->prefetched.get();
+        }
+        catch (...)
+        {
+            _impl->writeIndex = _impl->readIndex;
+            throw;
+        }
+
+        // swap: the back buffer becomes the front buffer
+        _impl->readIndex = _impl->writeIndex;
+        _impl->geometryChanged();
+        return result;
+    }
     return _load(chunkIndex, numChunks);
 }
 
+void EventSource::prefetch(const size_t chunkIndex, const size_t numChunks)
+{
+    const size_t totalChunks = getNumChunks();
+    if (totalChunks < 2 || numChunks == 0 ||
+        chunkIndex + numChunks > totalChunks)
+    {
+        return;
+    }
+
+    finishPrefetch();
+    _impl->writeIndex = 1 - _impl->readIndex;
+    _impl->writeBuffer().boundingBox = _impl->readBuffer().boundingBox;
+    _impl->prefetchChunk = chunkIndex;
+    _impl->prefetchNumChunks = numChunks;
+    _impl->prefetchTime = getCurrentTime();
+    _impl->prefetched =
+        std::async(std::launch::async, [this, chunkIndex, numChunks] {
+            // getters and geometry changes of the loader use the back buffer
+            struct Loading
+            {
+                explicit Loading(const Impl* impl) { loadingSource = impl; }
+                ~Loading() { loadingSource = nullptr; }
+            } loading(_impl.get());
+            return _load(chunkIndex, numChunks);
+        });
+}
+
+void EventSource::finishPrefetch()
+{
+    if (!_impl->prefetched.valid())
+        return;
+
+    try
+    {
+        _impl->prefetched.get();
+    }
+    catch (const std::exception& e)
+    {
+        LBWARN << "Discarded failed prefetch: " << e.what() << std::endl;
+    }
+    _impl->writeIndex = _impl->readIndex;
+}
+
 ssize_t EventSource::load()
 {
     return load(0, getNumChunks());
@@ -507,6 +1184,7 @@ size_t EventSource::getNumChunks() const
 
 bool EventSource::read(const std::string& filename)
 {
+    _impl->geometryChanged();
     if (_impl->readBinary(filename))
         return true;
 
@@ -45,6 +45,9 @@ public:
      * Resize the underlying event structure to the specified size, and
      * initialize all event attributes to 0
      *
+     * The allocation is kept when shrinking and grows geometrically, so
+     * chunked sources can resize for every batch without reallocating.
+     *
      * @param numEvents the number of events that the EventSource will hold
      */
     FIVOX_API void resize(size_t numEvents);
@@ -83,6 +86,8 @@ public:
      *
      * Returns a vector of values corresponding to a conservative set of events,
      * may contain events outside of the area, depending on the implementation.
+     * The events with a zero value may be omitted if the events with nonzero
+     * values are known, see getActiveEvents().
      *
      * @param area The query bounding box.
      * @return The values of the events contained in the area. Empty if no RTree
@@ -90,6 +95,22 @@ public:
      */
     FIVOX_API EventValues findEvents(const AABBf& area) const;
 
+    /**
+     * Find the events of the given group in the given area.
+     *
+     * @sa findEvents(const AABBf&), getGroups()
+     */
+    FIVOX_API EventValues findEvents(const AABBf& area, size_t group) const;
+
+    /**
+     * Find all events in the given area, e.g. to visit the events of all
+     * groups in one query.
+     *
+     * @sa findEvents(const AABBf&)
+     * @return the indices of the events contained in the area.
+     */
+    FIVOX_API brion::uint32_ts findEventIndices(const AABBf& area) const;
+
     /**
      * Set bounding box of upcoming events. This overwrites any existing
      * bounding box. It can be used to set a bounding box before
@@ -119,8 +140,165 @@ public:
     FIVOX_API void update(size_t i, const Vector3f& pos, float rad,
                           float val = 0.f);
 
+    /** @name Bulk update */
+    //@{
+    /**
+     * Set the positions of the events in [offset, offset + count) and merge
+     * them into the bounding box.
+     *
+     * Large ranges are copied and reduced in parallel. Thread safe for
+     * disjoint ranges, so loaders can fill the events from multiple threads.
+     *
+     * @param offset the index of the first event to update
+     * @param count the number of events to update
+     * @param x the X coordinates of the positions, count elements
+     * @param y the Y coordinates of the positions, count elements
+     * @param z the Z coordinates of the positions, count elements
+     * @throw std::out_of_range if the range exceeds the number of events.
+     */
+    FIVOX_API void setPositions(size_t offset, size_t count, const float* x,
+                                const float* y, const float* z);
+
+    /** @sa setPositions(size_t, size_t, const float*, const float*, const
+     *      float*) */
+    FIVOX_API void setPositions(size_t offset,
+                                const brion::Vector3fs& positions);
+
+    /**
+     * Set the radii of the events in [offset, offset + count). The radii are
+     * inverted as in update(). Thread safe for disjoint ranges.
+     *
+     * @throw std::out_of_range if the range exceeds the number of events.
+     */
+    FIVOX_API void setRadii(size_t offset, size_t count, const float* radii);
+
+    /** Set the same radius for all events in [offset, offset + count). */
+    FIVOX_API void setRadii(size_t offset, size_t count, float radius);
+
     /**
-     * @internal Called before data is read. Not thread safe.
+     * Set the values of the events in [offset, offset + count). Thread safe
+     * for disjoint ranges.
+     *
+     * @throw std::out_of_range if the range exceeds the number of events.
+     */
+    FIVOX_API void setValues(size_t offset, size_t count, const float* values);
+
+    /** Set the same value for all events in [offset, offset + count). */
+    FIVOX_API void setValues(size_t offset, size_t count, float value);
+
+    /**
+     * Use the given buffer as the values of all events instead of copying it.
+     *
+     * The buffer is kept alive and returned by getValues() until the next
+     * resize() or adoptValues(). The first write to the values afterwards,
+     * e.g. operator[] or setValues(), copies the buffer into the event source.
+     * Buffers not aligned to 16 bytes are copied right away. Not thread safe.
+     *
+     * @param values the values of all events
+     * @return true if the buffer was adopted, false if it was copied.
+     * @throw std::out_of_range if the buffer size is not getNumEvents().
+     */
+    FIVOX_API bool adoptValues(const brion::floatsPtr& values);
+
+    /**
+     * Set the values of the given events and 0 for all other events.
+     *
+     * Only the events of the previous call are reset, so sparse updates, e.g.
+     * of the neurons spiking in a time window, cost time proportional to the
+     * number of given events. The given events are returned by
+     * getActiveEvents(), so consumers can process only them. Not thread safe.
+     *
+     * @param indices the events with nonzero values, each at most once.
+     * @param values the values of the events, indices.size() elements.
+     * @throw std::out_of_range if an index is not smaller than getNumEvents().
+     */
+    FIVOX_API void setSparseValues(const brion::uint32_ts& indices,
+                                   const float* values);
+
+    /**
+     * @return the events with nonzero values, i.e. the events given to the
+     *         last setSparseValues(), or nullptr if they are unknown because
+     *         the values were changed otherwise since then.
+     */
+    FIVOX_API const brion::uint32_ts* getActiveEvents() const;
+
+    /**
+     * Keep only the events at the given indices, in the given order, e.g. to
+     * drop the events outside of a region of interest. The bounding box is
+     * unchanged. Not thread safe.
+     *
+     * @param indices the indices of the events to keep.
+     * @throw std::out_of_range if an index is not smaller than getNumEvents().
+     */
+    FIVOX_API void selectEvents(const brion::size_ts& indices);
+    //@}
+
+    /**
+     * Restrict the events to a region of interest.
+     *
+     * Used by decomposed jobs which sample only a part of the volume, with the
+     * sampled part grown by the cutoff distance as region. Loaders supporting
+     * it drop the events of the cells outside of the region and stop reading
+     * their data, so the memory and I/O per job shrink with the number of
+     * jobs. The bounding box is unchanged. Not thread safe.
+     *
+     * @param region the region of interest in world coordinates.
+     * @return the number of events left.
+     */
+    FIVOX_API size_t setRegionOfInterest(const AABBf& region);
+
+    /** @name Event groups */
+    //@{
+    /**
+     * Label the events with groups, e.g. the presynaptic target or the
+     * morphological type of their cell. Image sources produce one output
+     * channel per group in a single pass over the events.
+     *
+     * Called by the loaders supporting groups before setGroups(), the groups
+     * of all events are 0 afterwards. An empty list removes the groups.
+     *
+     * @param names the names of the groups, at most 65536.
+     * @throw std::out_of_range if there are too many groups.
+     */
+    FIVOX_API void setGroupNames(const brion::Strings& names);
+
+    /** @return the names of the event groups, empty if not grouped. */
+    FIVOX_API const brion::Strings& getGroupNames() const;
+
+    /** @return the number of event groups, 0 if not grouped. */
+    FIVOX_API size_t getNumGroups() const;
+
+    /**
+     * @return a const pointer to the group index of each event, nullptr if the
+     *         events are not grouped.
+     */
+    FIVOX_API const uint16_t* getGroups() const;
+
+    /**
+     * Set the groups of the events in [offset, offset + count). Thread safe
+     * for disjoint ranges.
+     *
+     * @throw std::out_of_range if the range exceeds the number of events or
+     *        a group is not smaller than getNumGroups().
+     */
+    FIVOX_API void setGroups(size_t offset, size_t count,
+                             const uint16_t* groups);
+
+    /** Set the same group for all events in [offset, offset + count). */
+    FIVOX_API void setGroups(size_t offset, size_t count, uint16_t group);
+    //@}
+
+    /**
+     * @return a version changed by every change of the number, positions or
+     *         groups of the events, to invalidate data derived from them. The
+     *         versions are unique across all event sources of the process.
+     */
+    FIVOX_API uint64_t getGeometryVersion() const;
+
+    /**
+     * @internal Called before data is read. Thread safe, a no-op if the
+     * events did not change since the last call, so image sources sharing
+     * this event source may call it concurrently.
      * Build an RTree so it can be used from findEvents() (depends
      * on boost::geometry)
      */
@@ -144,6 +322,26 @@ public:
      */
     FIVOX_API void setTime(double time);
 
+    /**
+     * Start reading the data of the given time stamp in the background, so a
+     * later load() at this time does not wait for I/O.
+     *
+     * Used to overlap reading the next frame with voxelizing the current one.
+     * No-op for sources without frame prefetching support.
+     *
+     * @param time The time stamp (ms) to be prefetched.
+     */
+    FIVOX_API void prefetch(double time);
+
+    /**
+     * Start reading the data of the given frame in the background.
+     *
+     * @param frame The frame number to be prefetched, see setFrame().
+     * @return true if the frame is within the range of the data source.
+     * @sa prefetch(double)
+     */
+    FIVOX_API bool prefetchFrame(uint32_t frame);
+
     /**
      * Gets the valid frame range according to data. The valid frames are in the
      * [a, b) range
@@ -191,6 +389,24 @@ public:
      */
     FIVOX_API ssize_t load();
 
+    /**
+     * Start loading the given chunks into the back buffer of the event source
+     * in a background thread.
+     *
+     * The events of the current chunks stay accessible until the next call to
+     * load() with the same chunks and time, which waits for the prefetch and
+     * swaps the buffers instead of loading. This overlaps loading chunk N+1
+     * with voxelizing chunk N. Only chunked sources (getNumChunks() > 1) are
+     * prefetched, this is a no-op otherwise. A load() of other chunks discards
+     * the prefetch and its errors.
+     *
+     * Not thread safe with any other update of the events.
+     *
+     * @param chunkIndex the chunk to start loading from
+     * @param numChunks the number of chunks to load into memory
+     */
+    FIVOX_API void prefetch(size_t chunkIndex, size_t numChunks);
+
     /** @return the maximum number of chunks provided by the data source. */
     FIVOX_API size_t getNumChunks() const;
 
@@ -246,6 +462,12 @@ protected:
     virtual size_t _getNumChunks() const = 0;
     //@}
 
+    /** @sa EventSource::prefetch( double ), no-op by default */
+    virtual void _prefetch(double /*time*/) {}
+
+    /** @sa EventSource::setRegionOfInterest(), no-op by default */
+    virtual void _setRegionOfInterest(const AABBf& /*region*/) {}
+
     /**
      * Set the dt that the datasource is using to correctly compute frame
      * number from time in load().
@@ -254,6 +476,14 @@ protected:
      */
     void setDt(double dt);
 
+    /**
+     * Wait for a pending prefetch() and discard it.
+     *
+     * Must be called in the destructor of derived classes, before their state
+     * is destroyed, as a prefetch calls their _load().
+     */
+    void finishPrefetch();
+
 private:
     class Impl;
     std::unique_ptr<Impl> _impl;
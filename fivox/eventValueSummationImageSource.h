@@ -22,6 +22,9 @@
 #define FIVOX_EVENTVALUESUMMATIONIMAGESOURCE_H
 
 #include <fivox/imageSource.h>
+
+#include <utility>
+#include <vector>
 #include <fivox/types.h>
 
 namespace fivox
@@ -53,6 +56,23 @@ public:
     void operator=(const EventValueSummationImageSource&) = delete;
 
     void GenerateData() override;
+
+private:
+    /**
+     * Events inside the volume sorted by output channel and voxel, as pairs
+     * of channel << 48 | voxel offset and event index. Cached across frames
+     * for event sources loaded in one chunk while their geometry does not
+     * change.
+     */
+    std::vector<std::pair<uint64_t, size_t>> _voxels;
+
+    // state of the event source and the volume used for _voxels
+    uint64_t _voxelGeometryVersion;
+    typename TImage::RegionType _voxelRegion;
+    typename TImage::PointType _voxelOrigin;
+    typename TImage::SpacingType _voxelSpacing;
+    size_t _voxelChannels;
+    bool _hasVoxels; // false until the state is unchanged for a second frame
 };
 
 } // end namespace fivox
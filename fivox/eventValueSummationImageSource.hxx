@@ -27,12 +27,104 @@
 
 #include <lunchbox/clock.h>
 
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <thread>
+
 namespace fivox
 {
+namespace detail
+{
+/**
+ * Threads calling a function with their index, kept for all batches of an
+ * update instead of starting new threads for each batch.
+ */
+class Workers
+{
+public:
+    explicit Workers( const size_t numThreads )
+        : _func( nullptr )
+        , _generation( 0 )
+        , _pending( 0 )
+        , _stop( false )
+    {
+        // the calling thread runs index 0
+        for( size_t i = 1; i < numThreads; ++i )
+            _threads.emplace_back( [this, i] { _work( i ); });
+    }
+
+    ~Workers()
+    {
+        {
+            std::lock_guard< std::mutex > lock( _mutex );
+            _stop = true;
+        }
+        _start.notify_all();
+        for( auto& thread : _threads )
+            thread.join();
+    }
+
+    size_t getSize() const { return _threads.size() + 1; }
+
+    /** Call func( i ) for all indices concurrently, return when all are done */
+    void run( const std::function< void( size_t ) >& func )
+    {
+        {
+            std::lock_guard< std::mutex > lock( _mutex );
+            _func = &func;
+            _pending = _threads.size();
+            ++_generation;
+        }
+        _start.notify_all();
+        func( 0 );
+
+        std::unique_lock< std::mutex > lock( _mutex );
+        _done.wait( lock, [this] { return _pending == 0; });
+    }
+
+private:
+    void _work( const size_t index )
+    {
+        uint64_t generation = 0;
+        std::unique_lock< std::mutex > lock( _mutex );
+        while( true )
+        {
+            _start.wait( lock, [&]
+                { return _stop || _generation != generation; });
+            if( _stop )
+                return;
+
+            generation = _generation;
+            const std::function< void( size_t ) >& func = *_func;
+            lock.unlock();
+            func( index );
+            lock.lock();
+            if( --_pending == 0 )
+                _done.notify_one();
+        }
+    }
+
+    std::vector< std::thread > _threads;
+    std::mutex _mutex;
+    std::condition_variable _start;
+    std::condition_variable _done;
+    const std::function< void( size_t ) >* _func;
+    uint64_t _generation;
+    size_t _pending;
+    bool _stop;
+};
+}
 
 template< typename TImage >
 EventValueSummationImageSource< TImage >::EventValueSummationImageSource()
     : ImageSource< TImage >()
+    , _voxelGeometryVersion( 0 )
+    , _voxelChannels( 0 )
+    , _hasVoxels( false )
 {
 }
 
@@ -45,58 +137,336 @@ void EventValueSummationImageSource< TImage >::GenerateData()
     image->Allocate();
     image->FillBuffer( 0 );
 
+    // one image per event group, filled in the same pass over the events
+    std::vector< typename Superclass::ImagePointer > channels( 1, image );
+    for( size_t c = 1; c < Superclass::getNumChannels(); ++c )
+    {
+        channels.push_back( Superclass::GetOutput( c ));
+        channels.back()->SetBufferedRegion( image->GetRequestedRegion( ));
+        channels.back()->Allocate();
+        channels.back()->FillBuffer( 0 );
+    }
+
     auto source = Superclass::_eventSource;
-    const auto numChunks = source->getNumChunks();
-    itk::ProgressReporter progress( this, 0, numChunks );
-    size_t totalEvents = 0;
-    typename TImage::PixelType maxValue = 0;
 
-    // start with batch size of at most 10, adapts to target time wrt loading
-    // time of event source
-    size_t batchSize = std::min( size_t(10), numChunks );
+    // voxel index arithmetic on the raw buffers, as done by
+    // TransformPhysicalPointToIndex() for the identity direction of the volumes
+    const typename TImage::RegionType& region = image->GetBufferedRegion();
+    const typename TImage::PointType& origin = image->GetOrigin();
+    const typename TImage::SpacingType& spacing = image->GetSpacing();
+    double invSpacing[3];
+    long dims[3];
+    for( size_t i = 0; i < 3; ++i )
+    {
+        invSpacing[i] = 1. / spacing[i];
+        dims[i] = region.GetSize()[i];
+    }
+    const typename TImage::IndexType& first = region.GetIndex();
 
-    for( size_t i = 0; i < numChunks; )
+    typedef typename TImage::PixelType PixelType;
+    const size_t minEventsPerThread = 65536;
+    std::vector< PixelType* > buffers;
+    for( const auto& channel : channels )
+        buffers.push_back( channel->GetBufferPointer( ));
+
+    // @return the offset of the voxel of the given event in the buffers, or
+    //         -1 if it is outside of the volume
+    const auto getVoxel = [&]( const float px, const float py,
+                               const float pz ) -> long
     {
-        lunchbox::Clock clock;
-        totalEvents += source->load( i, batchSize );
+        const long z = std::floor(( pz - origin[2] ) * invSpacing[2] + .5 ) -
+                       first[2];
+        const long y = std::floor(( py - origin[1] ) * invSpacing[1] + .5 ) -
+                       first[1];
+        const long x = std::floor(( px - origin[0] ) * invSpacing[0] + .5 ) -
+                       first[0];
+        if( x < 0 || x >= dims[0] || y < 0 || y >= dims[1] || z < 0 ||
+            z >= dims[2] )
+        {
+            return -1l;
+        }
+        return x + dims[0] * ( y + dims[1] * z );
+    };
+
+    // Each thread owns a slab of z slices of all channels and adds the events
+    // falling into it, so no voxel is written by two threads and the values
+    // are summed in the same order as by a single thread.
+    const long numSlabs = std::max( 1l, std::min< long >(
+                                  this->GetNumberOfThreads(), dims[2] ));
+    const auto slabBegin = [&]( const long slab )
+        { return dims[2] * slab / numSlabs; };
+    const size_t sliceSize = dims[0] * dims[1];
+    std::vector< size_t > slabOfSlice( dims[2] );
+    for( long slab = 0; slab < numSlabs; ++slab )
+        std::fill( slabOfSlice.begin() + slabBegin( slab ),
+                   slabOfSlice.begin() + slabBegin( slab + 1 ), slab );
+    detail::Workers workers( numSlabs );
+
+    const uint64_t invalidKey = std::numeric_limits< uint64_t >::max();
+    const uint64_t voxelMask = ( uint64_t( 1 ) << 48 ) - 1;
 
+    // only the events with nonzero values, if few, see getActiveEvents()
+    const brion::uint32_ts* activeEvents = nullptr;
+
+    // kept across batches: the key of each event of a batch, the events
+    // binned by slab as pairs of key and event index, and the events of each
+    // thread per slab
+    std::vector< uint64_t > keys;
+    std::vector< std::pair< uint64_t, size_t >> binned;
+    std::vector< size_t > counts;
+
+    const auto scatter = [&]
+    {
+        const size_t numEvents = activeEvents ? activeEvents->size()
+                                              : source->getNumEvents();
+        const uint32_t* __restrict__ active =
+            activeEvents ? activeEvents->data() : nullptr;
         const float* __restrict__ posx = source->getPositionsX();
         const float* __restrict__ posy = source->getPositionsY();
         const float* __restrict__ posz = source->getPositionsZ();
         const float* __restrict__ values = source->getValues();
+        const uint16_t* __restrict__ groups =
+            buffers.size() > 1 ? source->getGroups() : nullptr;
+
+        // @return channel << 48 | voxel of the given event, or invalidKey
+        const auto getKey = [&]( const size_t j ) -> uint64_t
+        {
+            const long voxel = getVoxel( posx[j], posy[j], posz[j] );
+            if( voxel < 0 )
+                return invalidKey;
+            return uint64_t( groups ? groups[j] : 0 ) << 48 | uint64_t( voxel );
+        };
+        const auto add = [&]( const uint64_t key, const size_t j )
+        {
+            PixelType& pixel = buffers[key >> 48][key & voxelMask];
+            pixel = pixel + values[j];
+        };
+        const auto getSlab = [&]( const uint64_t key )
+            { return slabOfSlice[( key & voxelMask ) / sliceSize]; };
+
+        if( numEvents < minEventsPerThread || numSlabs == 1 )
+        {
+            for( size_t k = 0; k < numEvents; ++k )
+            {
+                const size_t j = active ? active[k] : k;
+                const uint64_t key = getKey( j );
+                if( key != invalidKey )
+                    add( key, j );
+            }
+            return;
+        }
+
+        // bin the events by slab once: each thread computes the keys of a
+        // range of events and counts them per slab, ...
+        const auto rangeBegin = [&]( const size_t thread )
+            { return numEvents * thread / numSlabs; };
+        keys.resize( numEvents );
+        counts.assign( numSlabs * numSlabs, 0 );
+        workers.run( [&]( const size_t thread )
+        {
+            size_t* count = counts.data() + thread * numSlabs;
+            for( size_t k = rangeBegin( thread ); k < rangeBegin( thread + 1 );
+                 ++k )
+            {
+                keys[k] = getKey( active ? active[k] : k );
+                if( keys[k] != invalidKey )
+                    ++count[getSlab( keys[k] )];
+            }
+        });
+
+        // ... the ranges are placed in event order within each slab, ...
+        std::vector< size_t > slabOffsets( 1, 0 );
+        for( long slab = 0; slab < numSlabs; ++slab )
+        {
+            size_t offset = slabOffsets.back();
+            for( long thread = 0; thread < numSlabs; ++thread )
+            {
+                size_t& count = counts[thread * numSlabs + slab];
+                const size_t size = count;
+                count = offset;
+                offset += size;
+            }
+            slabOffsets.push_back( offset );
+        }
+
+        // ... and copy their events into the bins
+        binned.resize( slabOffsets.back( ));
+        workers.run( [&]( const size_t thread )
+        {
+            size_t* next = counts.data() + thread * numSlabs;
+            for( size_t k = rangeBegin( thread ); k < rangeBegin( thread + 1 );
+                 ++k )
+            {
+                if( keys[k] != invalidKey )
+                    binned[next[getSlab( keys[k] )]++] =
+                        std::make_pair( keys[k], active ? active[k] : k );
+            }
+        });
+
+        workers.run( [&]( const size_t slab )
+        {
+            for( size_t k = slabOffsets[slab]; k < slabOffsets[slab + 1]; ++k )
+                add( binned[k].first, binned[k].second );
+        });
+    };
+
+    // Sources loaded in one chunk usually keep their geometry across frames.
+    // Once it is unchanged for a second frame, the voxel of each event is
+    // cached and a frame only gathers the values in voxel order, each thread
+    // a range of voxels. @return false if the events need to be scattered.
+    const auto accumulate = [&]() -> bool
+    {
+        // the geometry versions are unique across event sources
+        if( _voxelGeometryVersion != source->getGeometryVersion() ||
+            _voxelRegion != region || _voxelOrigin != origin ||
+            _voxelSpacing != spacing || _voxelChannels != buffers.size( ))
+        {
+            _voxelGeometryVersion = source->getGeometryVersion();
+            _voxelRegion = region;
+            _voxelOrigin = origin;
+            _voxelSpacing = spacing;
+            _voxelChannels = buffers.size();
+            _voxels.clear();
+            _hasVoxels = false;
+            return false;
+        }
+
+        if( !_hasVoxels )
+        {
+            const size_t numEvents = source->getNumEvents();
+            const float* posx = source->getPositionsX();
+            const float* posy = source->getPositionsY();
+            const float* posz = source->getPositionsZ();
+            const uint16_t* groups =
+                buffers.size() > 1 ? source->getGroups() : nullptr;
+
+            for( size_t j = 0; j < numEvents; ++j )
+            {
+                const long voxel = getVoxel( posx[j], posy[j], posz[j] );
+                if( voxel >= 0 )
+                    _voxels.emplace_back( uint64_t( groups ? groups[j] : 0 )
+                                              << 48 | uint64_t( voxel ), j );
+            }
+            // sorted by event index per voxel, so the values are summed in
+            // the same order as by scatter()
+            std::sort( _voxels.begin(), _voxels.end( ));
+            _hasVoxels = true;
+        }
+
+        const float* __restrict__ values = source->getValues();
+        const auto gather = [&]( const size_t begin, const size_t end )
+        {
+            for( size_t k = begin; k < end; ++k )
+            {
+                const uint64_t key = _voxels[k].first;
+                PixelType& pixel = buffers[key >> 48][key & voxelMask];
+                pixel = pixel + values[_voxels[k].second];
+            }
+        };
 
-        #pragma vector aligned
-        for( size_t j = 0; j < source->getNumEvents(); ++j )
+        const size_t size = _voxels.size();
+        if( size < minEventsPerThread )
         {
-            typename TImage::PointType point;
-            point[0] = posx[j];
-            point[1] = posy[j];
-            point[2] = posz[j];
-            typename Superclass::ImageIndexType index;
-            if( image->TransformPhysicalPointToIndex( point, index ))
+            gather( 0, size );
+            return true;
+        }
+
+        // split at voxel boundaries, so no voxel is added by two threads
+        std::vector< size_t > splits( 1, 0 );
+        for( long i = 1; i < numSlabs; ++i )
+        {
+            size_t split = std::max( splits.back(), size * i / numSlabs );
+            while( split > 0 && split < size &&
+                   _voxels[split].first == _voxels[split - 1].first )
             {
-                const typename TImage::PixelType value =
-                        image->GetPixel( index ) + values[j];
-                maxValue = std::max( maxValue, value );
-                image->SetPixel( index, value );
+                ++split;
             }
+            splits.push_back( split );
         }
+        splits.push_back( size );
+
+        workers.run( [&]( const size_t i )
+            { gather( splits[i], splits[i + 1] ); });
+        return true;
+    };
+
+    const auto numChunks = source->getNumChunks();
+    itk::ProgressReporter progress( this, 0, numChunks );
+    size_t totalEvents = 0;
+
+    // Two-stage pipeline: the next batch of chunks is loaded into the back
+    // buffer of the event source while the current one is scattered. Start
+    // with batch size of at most 10, adapts to the time per chunk of the
+    // slower stage.
+    size_t batchSize = std::min( size_t(10), numChunks );
+    size_t nextBatchSize = batchSize;
+    float scatterTime = 0.f; // of the previous batch
+
+    for( size_t i = 0; i < numChunks; )
+    {
+        lunchbox::Clock clock;
+        // a single chunk may be loaded by the caller, see setLoadEvents()
+        if( numChunks > 1 || Superclass::_loadEvents )
+            totalEvents += source->load( i, batchSize );
+        else
+            totalEvents += source->getNumEvents();
+        const float loadTime = clock.getTimef();
+
+        const size_t next = i + batchSize;
+        nextBatchSize = std::min( nextBatchSize, numChunks - next );
+        if( nextBatchSize > 0 )
+            source->prefetch( next, nextBatchSize );
+
+        // sparse values, e.g. the few spiking neurons of a frame, are
+        // scattered directly, which is cheaper than gathering all events
+        const size_t numEvents = source->getNumEvents();
+        activeEvents = source->getActiveEvents();
+        if( activeEvents && activeEvents->size() * 4 >= numEvents )
+            activeEvents = nullptr;
+
+        if( numChunks > 1 || activeEvents || !accumulate( ))
+            scatter();
 
         for( size_t j = 0; j < batchSize; ++j )
             progress.CompletedPixel();
 
-        i += batchSize;
-        LBDEBUG << "Batch " << i-batchSize << " to " << i << " took "
-                << clock.getTime64() << "ms" << std::endl;
+        const float time = clock.getTimef();
+        LBDEBUG << "Batch " << i << " to " << next << " took " << time
+                << "ms, " << loadTime << "ms waiting for the load" << std::endl;
 
-        // ensure an update of the progress every 500ms, clamp lower limit to
-        // remaining chunks. Upper limit could be clamped to not overcommit
-        // memory, but with current data sources one should not reach that limit
-        // within 500ms.
-        batchSize = std::max( 1.f, batchSize * 500.f / clock.getTimef( ));
-        batchSize = std::min( batchSize, numChunks - i );
+        // The load of a prefetched batch ran during the scatter of the
+        // previous one and the wait for it, which bounds its duration. In
+        // steady state an iteration takes as long as the slower stage, so
+        // size the batches for 500ms of the slower stage per batch. This
+        // amortizes the per-batch overhead and updates the progress every
+        // 500ms. The next batch is already loading, the size applies to the
+        // one after.
+        const float batchLoadTime =
+            i > 0 && numChunks > 1 ? loadTime + scatterTime : loadTime;
+        scatterTime = time - loadTime;
+        const float chunkTime =
+            std::max( std::max( batchLoadTime, scatterTime ) / batchSize,
+                      0.001f );
+        const size_t plannedSize =
+            std::max( 1.f, std::min( float( numChunks ), 500.f / chunkTime ));
+        i = next;
+        batchSize = nextBatchSize;
+        nextBatchSize = plannedSize;
     }
 
+    // maximum of all channels, reduced over the slabs in parallel
+    std::vector< PixelType > maxValues( numSlabs, 0 );
+    workers.run( [&]( const size_t slab )
+    {
+        const size_t begin = slabBegin( slab ) * sliceSize;
+        const size_t end = slabBegin( slab + 1 ) * sliceSize;
+        for( const PixelType* buffer : buffers )
+            for( size_t j = begin; j < end; ++j )
+                maxValues[slab] = std::max( maxValues[slab], buffer[j] );
+    });
+    const PixelType maxValue =
+        *std::max_element( maxValues.begin(), maxValues.end( ));
+
     LBINFO << "Voxelized " << totalEvents << " events for "
            << numChunks << " chunks, max value "
            << size_t( maxValue ) << std::endl;
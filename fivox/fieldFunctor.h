@@ -25,6 +25,8 @@
 #include <fivox/api.h>
 #include <fivox/eventFunctor.h> // base class
 
+#include <vector>
+
 namespace fivox
 {
 /** Samples spatial events into the given pixel using a squared falloff. */
@@ -44,6 +46,10 @@ public:
     FIVOX_API virtual ~FieldFunctor() {}
     FIVOX_API TPixel operator()(const TPoint& point,
                                 const TSpacing& spacing) const override;
+    FIVOX_API bool supportsGroups() const override { return true; }
+    FIVOX_API void sampleGroups(const TPoint& point, const TSpacing& spacing,
+                                size_t numGroups,
+                                TPixel* pixels) const override;
 };
 
 template <class TImage>
@@ -101,6 +107,53 @@ inline typename FieldFunctor<TImage>::TPixel FieldFunctor<TImage>::operator()(
     }
     return voltage1 + voltage2;
 }
+
+template <class TImage>
+inline void FieldFunctor<TImage>::sampleGroups(const TPoint& point,
+                                               const TSpacing&,
+                                               const size_t numGroups,
+                                               TPixel* pixels) const
+{
+    std::fill(pixels, pixels + numGroups, TPixel(0));
+    if (!Super::_source)
+        return;
+
+    const float cutOffDistance = Super::_source->getCutOffDistance();
+
+    const size_t size = Super::_source->getNumEvents();
+    const float* __restrict__ posx = Super::_source->getPositionsX();
+    const float* __restrict__ posy = Super::_source->getPositionsY();
+    const float* __restrict__ posz = Super::_source->getPositionsZ();
+    const float* __restrict__ radii = Super::_source->getRadii();
+    const float* __restrict__ values = Super::_source->getValues();
+    const uint16_t* __restrict__ groups = Super::_source->getGroups();
+
+    const float px(point[0]), py(point[1]), pz(point[2]);
+    const float squaredCutoff = 1.f / (cutOffDistance * cutOffDistance);
+
+    // each event is visited once and added to the voltage of its group
+    for (size_t i = 0; i < size; ++i)
+    {
+        const size_t group = groups ? groups[i] : 0;
+        if (group >= numGroups)
+            continue;
+
+        const float distanceX = px - posx[i];
+        const float distanceY = py - posy[i];
+        const float distanceZ = pz - posz[i];
+
+        const float distance2(1.f /
+                              (distanceX * distanceX + distanceY * distanceY +
+                               distanceZ * distanceZ));
+        if (distance2 < squaredCutoff)
+            continue;
+
+        const float radius(radii[i]);
+        pixels[group] += values[i] * (distance2 > radius * radius
+                                          ? radius
+                                          : distance2); // mV
+    }
+}
 }
 
 #endif
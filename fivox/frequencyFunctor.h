@@ -25,6 +25,8 @@
 #include <fivox/api.h>
 #include <fivox/eventFunctor.h> // base class
 
+#include <vector>
+
 namespace fivox
 {
 /** Projects maximum frequency of events into the given voxel. */
@@ -50,6 +52,10 @@ public:
 
     FIVOX_API TPixel operator()(const TPoint& point,
                                 const TSpacing& spacing) const override;
+    FIVOX_API bool supportsGroups() const override { return true; }
+    FIVOX_API void sampleGroups(const TPoint& point, const TSpacing& spacing,
+                                size_t numGroups,
+                                TPixel* pixels) const override;
 };
 
 template <class TImage>
@@ -77,6 +83,39 @@ inline typename FrequencyFunctor<TImage>::TPixel FrequencyFunctor<TImage>::
 
     return sum;
 }
+
+template <class TImage>
+inline void FrequencyFunctor<TImage>::sampleGroups(const TPoint& itkPoint,
+                                                   const TSpacing& itkSpacing,
+                                                   const size_t numGroups,
+                                                   TPixel* pixels) const
+{
+    std::fill(pixels, pixels + numGroups, TPixel(0));
+    if (!Super::_source)
+        return;
+
+    Vector3f point;
+    Vector3f spacing_2;
+    const size_t components = std::min(itkPoint.Size(), 3u);
+    for (size_t i = 0; i < components; ++i)
+    {
+        point[i] = itkPoint[i];
+        spacing_2[i] = itkSpacing[i] * 0.5;
+    }
+
+    // one query for all groups, each event goes into the pixel of its group
+    const AABBf region(point - spacing_2, point + spacing_2);
+    const brion::uint32_ts& indices = Super::_source->findEventIndices(region);
+    const float* values = Super::_source->getValues();
+    const uint16_t* groups = Super::_source->getGroups();
+
+    for (const uint32_t index : indices)
+    {
+        const size_t group = groups ? groups[index] : 0;
+        if (group < numGroups)
+            pixels[group] = std::max(pixels[group], TPixel(values[index]));
+    }
+}
 }
 
 #endif
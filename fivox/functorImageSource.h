@@ -51,6 +51,15 @@ public:
     /** Set a new functor. */
     void setFunctor(FunctorPtr functor);
 
+    /** Set the event source sampled by this image source and its functor. */
+    void setEventSource(EventSourcePtr source) override;
+
+    /**
+     * Sample rows of voxels at once if supported by the functor, see
+     * EventFunctor::sampleRow(). Enabled by default.
+     */
+    void setRowSampling(bool enable);
+
 protected:
     FunctorImageSource();
     virtual ~FunctorImageSource() {}
@@ -71,6 +80,7 @@ protected:
 
 private:
     FunctorPtr _functor;
+    bool _rowSampling;
     lunchbox::Monitor<size_t> _completed;
     itk::ImageRegionSplitterBase::Pointer _splitter;
 };
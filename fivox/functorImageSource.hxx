@@ -27,12 +27,15 @@
 #include <itkImageRegionSplitterDirection.h>
 #include <itkProgressReporter.h>
 
+#include <vector>
+
 namespace fivox
 {
 static const int _splitDirection = 2; // fastest in latest test
 
 template< typename TImage > FunctorImageSource< TImage >::FunctorImageSource()
     : ImageSource< TImage >()
+    , _rowSampling( true )
 {
     itk::ImageRegionSplitterDirection::Pointer splitter =
         itk::ImageRegionSplitterDirection::New();
@@ -52,6 +55,20 @@ void FunctorImageSource< TImage >::setFunctor( FunctorPtr functor )
     _functor = functor;
 }
 
+template< typename TImage >
+void FunctorImageSource< TImage >::setEventSource( EventSourcePtr source )
+{
+    Superclass::setEventSource( source );
+    if( _functor )
+        _functor->setEventSource( source );
+}
+
+template< typename TImage >
+void FunctorImageSource< TImage >::setRowSampling( const bool enable )
+{
+    _rowSampling = enable;
+}
+
 template< typename TImage >
 void FunctorImageSource< TImage >::ThreadedGenerateData(
     const typename Superclass::ImageRegionType& outputRegionForThread,
@@ -68,32 +85,63 @@ void FunctorImageSource< TImage >::ThreadedGenerateData(
     itk::ProgressReporter progress( this, threadId, nLines );
     size_t totalLines = 0;
 
+    // channels of grouped events are sampled in the same iteration
+    const size_t numChannels = Superclass::getNumChannels();
+    std::vector< typename Superclass::ImagePointer > channels;
+    for( size_t c = 1; c < numChannels; ++c )
+        channels.push_back( Superclass::GetOutput( c ));
+
+    const typename TImage::SpacingType spacing = image->GetSpacing();
+    std::vector< typename TImage::PixelType > row(
+        outputRegionForThread.GetSize()[0] );
+    std::vector< typename TImage::PixelType > groupPixels( numChannels );
+
     while( !i.IsAtEnd( ))
     {
-        const typename Superclass::ImageIndexType& index = i.GetIndex();
-
-        const typename TImage::SpacingType spacing = image->GetSpacing();
         typename TImage::PointType point;
-        image->TransformIndexToPhysicalPoint( index, point );
+        image->TransformIndexToPhysicalPoint( i.GetIndex(), point );
 
-        i.Set( (*_functor)( point, spacing ) );
-
-        ++i;
-        if( i.IsAtEndOfLine( ))
+        if( numChannels == 1 && _rowSampling &&
+            _functor->sampleRow( point, spacing, row.size(), row.data( )))
+        {
+            for( const auto& value : row )
+            {
+                i.Set( value );
+                ++i;
+            }
+        }
+        else
         {
-            i.NextLine();
-            // report progress only once per line for lower contention on
-            // monitor. Main thread reports to itk, all others to the monitor.
-            if( threadId == 0 )
+            for( ; !i.IsAtEndOfLine(); ++i )
             {
-                size_t done = _completed.set( 0 ) + 1 /*self*/;
-                totalLines += done;
-                while( done-- )
-                    progress.CompletedPixel();
+                const typename Superclass::ImageIndexType& index = i.GetIndex();
+                image->TransformIndexToPhysicalPoint( index, point );
+
+                if( numChannels == 1 )
+                    i.Set( (*_functor)( point, spacing ));
+                else
+                {
+                    _functor->sampleGroups( point, spacing, numChannels,
+                                            groupPixels.data( ));
+                    i.Set( groupPixels[0] );
+                    for( size_t c = 1; c < numChannels; ++c )
+                        channels[c-1]->SetPixel( index, groupPixels[c] );
+                }
             }
-            else
-                ++_completed;
         }
+
+        i.NextLine();
+        // report progress only once per line for lower contention on
+        // monitor. Main thread reports to itk, all others to the monitor.
+        if( threadId == 0 )
+        {
+            size_t done = _completed.set( 0 ) + 1 /*self*/;
+            totalLines += done;
+            while( done-- )
+                progress.CompletedPixel();
+        }
+        else
+            ++_completed;
     }
 
     if( threadId == 0 )
@@ -117,19 +165,25 @@ void FunctorImageSource< TImage >::BeforeThreadedGenerateData()
     if( !source )
         return;
 
-    const ssize_t updatedEvents = source->load();
-    const float time = source->getCurrentTime();
-    if( updatedEvents < 0 )
+    if( Superclass::_loadEvents )
     {
-        LBERROR << "Timestamp " << time << "ms not loaded, no data or events"
-                << std::endl;
-    }
-    else
-    {
-        LBINFO << "Timestamp " << time << "ms loaded, updated " << updatedEvents
-               << " event(s)" << std::endl;
+        const ssize_t updatedEvents = source->load();
+        const float time = source->getCurrentTime();
+        if( updatedEvents < 0 )
+        {
+            LBERROR << "Timestamp " << time
+                    << "ms not loaded, no data or events" << std::endl;
+        }
+        else
+        {
+            LBINFO << "Timestamp " << time << "ms loaded, updated "
+                   << updatedEvents << " event(s)" << std::endl;
+        }
     }
 
+    if( Superclass::getNumChannels() > 1 && !_functor->supportsGroups( ))
+        LBTHROW( std::runtime_error( "Functor does not support event groups" ));
+
     _completed = 0;
     _functor->beforeGenerate();
     Superclass::_progressObserver->reset();
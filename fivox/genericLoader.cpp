@@ -40,13 +40,16 @@ public:
     {
         if (_file.empty())
         {
-            _output.resize(7);
-
+            brion::Vector3fs positions;
             for (uint8_t y = 0; y < 5; ++y)
-                _output.update(y, Vector3f(0.f, y * 10.f, 0.f), 1.f);
+                positions.push_back(Vector3f(0.f, y * 10.f, 0.f));
+            positions.push_back(Vector3f(3.f, 5.f, 4.f));
+            positions.push_back(Vector3f(5.f, 2.f, 1.f));
 
-            _output.update(5, Vector3f(3.f, 5.f, 4.f), 1.f);
-            _output.update(6, Vector3f(5.f, 2.f, 1.f), 1.f);
+            _output.resize(positions.size());
+            _output.setPositions(0, positions);
+            _output.setRadii(0, positions.size(), 1.f);
+            _output.setValues(0, positions.size(), 0.f);
 
             return;
         }
@@ -77,6 +80,7 @@ GenericLoader::GenericLoader(const URIHandler& params)
 
 GenericLoader::~GenericLoader()
 {
+    finishPrefetch();
 }
 
 Vector2f GenericLoader::_getTimeRange() const
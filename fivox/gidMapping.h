@@ -0,0 +1,133 @@
+/* Copyright (c) 2017, EPFL/Blue Brain Project
+ *
+ * This file is part of Fivox <https://github.com/BlueBrain/Fivox>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef FIVOX_GIDMAPPING_H
+#define FIVOX_GIDMAPPING_H
+
+#include <brion/types.h>
+
+#include <algorithm>
+#include <limits>
+
+namespace fivox
+{
+/**
+ * Maps the GIDs of a target to their index in the target.
+ *
+ * The memory is bounded by 32 bytes per GID of the target, independently of
+ * the GID range. Targets with a GID range of up to eight times their size use
+ * a direct lookup table over the range, which is as fast as the lookup in an
+ * array over all GIDs. Sparser targets use an open addressing hash table with
+ * linear probing at a load factor of at most 0.5.
+ */
+class GIDMapping
+{
+public:
+    /** Returned by find() for GIDs not in the target */
+    static size_t invalid() { return std::numeric_limits<size_t>::max(); }
+
+    explicit GIDMapping(const brion::GIDSet& gids)
+        : _size(gids.size())
+        , _first(gids.empty() ? 0 : *gids.begin())
+        , _mask(0)
+    {
+        if (gids.empty())
+            return;
+
+        uint32_t index = 0;
+        const size_t range = size_t(*gids.rbegin()) - _first + 1;
+        if (range <= 8 * _size)
+        {
+            _table.resize(range, _empty);
+            for (const uint32_t gid : gids)
+                _table[gid - _first] = index++;
+            return;
+        }
+
+        size_t capacity = 1;
+        while (capacity < 2 * _size)
+            capacity <<= 1;
+        _mask = capacity - 1;
+        _slots.resize(capacity, Slot{0, _empty});
+
+        for (const uint32_t gid : gids)
+        {
+            size_t i = _hash(gid);
+            while (_slots[i].index != _empty)
+                i = (i + 1) & _mask;
+            _slots[i] = Slot{gid, index++};
+        }
+    }
+
+    /** @return the number of GIDs in the target */
+    size_t size() const { return _size; }
+
+    /** @return the size in bytes of the lookup tables */
+    size_t getMemorySize() const
+    {
+        return _table.size() * sizeof(uint32_t) + _slots.size() * sizeof(Slot);
+    }
+
+    /** @return the index of the GID in the target, or invalid() */
+    size_t find(const uint32_t gid) const
+    {
+        if (_slots.empty())
+        {
+            const size_t i = size_t(gid) - _first;
+            return gid >= _first && i < _table.size() && _table[i] != _empty
+                       ? _table[i]
+                       : invalid();
+        }
+
+        for (size_t i = _hash(gid);; i = (i + 1) & _mask)
+        {
+            const Slot& slot = _slots[i];
+            if (slot.index == _empty)
+                return invalid();
+            if (slot.gid == gid)
+                return slot.index;
+        }
+    }
+
+private:
+    struct Slot
+    {
+        uint32_t gid;
+        uint32_t index;
+    };
+
+    enum : uint32_t
+    {
+        _empty = 0xffffffffu // unused entry
+    };
+
+    size_t _hash(const uint32_t gid) const
+    {
+        // Fibonacci hashing spreads clustered GIDs over the table
+        return (uint64_t(gid) * 11400714819323198485ull >> 32) & _mask;
+    }
+
+    const size_t _size;
+    const uint32_t _first;
+    size_t _mask;
+    std::vector<uint32_t> _table; // index of GID _first + i, or _empty
+    std::vector<Slot> _slots;
+};
+}
+
+#endif
@@ -21,8 +21,12 @@
 #ifndef FIVOX_HELPERS_H
 #define FIVOX_HELPERS_H
 
+#include "cache.h"
+
 #include <fivox/eventSource.h>
+#include <fivox/uriHandler.h>
 
+#include <brain/circuit.h>
 #include <brain/neuron/morphology.h>
 #include <brain/neuron/section.h>
 #include <brain/neuron/soma.h>
@@ -30,11 +34,33 @@
 #include <brion/types.h>
 
 #include <lunchbox/log.h>
+#include <lunchbox/memoryMap.h>
+
+#include <algorithm>
+#include <future>
+#include <limits>
+#include <map>
+#include <thread>
+#include <unordered_map>
 
 namespace fivox
 {
 namespace helpers
 {
+/**
+ * Header of a compartment event cache file, followed by the x, y, z positions
+ * and the radii of numEvents events.
+ */
+struct EventCacheHeader
+{
+    static const uint32_t currentMagic = 0xfe7e;
+    static const uint32_t currentVersion = 1;
+
+    uint32_t magic;
+    uint32_t version;
+    uint64_t numEvents;
+};
+
 /** Tuple of buffer offset, cell index, section ID, compartment counts */
 typedef std::tuple<size_t, uint32_t, uint32_t, uint16_t> MappingElement;
 typedef std::vector<MappingElement> FlatInverseMapping;
@@ -42,27 +68,74 @@ typedef std::vector<MappingElement> FlatInverseMapping;
 /**
  * Computes a report mapping that enumerates compartments in the same
  * order they appear in the data buffer.
+ *
+ * The sections of each cell are sorted in parallel and the cells are ordered
+ * by their first offset, which gives the buffer order if the compartments of
+ * each cell are contiguous. Other layouts fall back to sorting all sections.
+ *
  * @param report The report from which the mapping is computed.
  * @return A list of tuples (offset, cell index, section ID, compartment count).
  */
 inline FlatInverseMapping computeInverseMapping(
     const brion::CompartmentReport& report)
 {
-    FlatInverseMapping mapping;
-    mapping.reserve(report.getBufferSize());
-
     const auto& offsets = report.getOffsets();
     const auto& counts = report.getCompartmentCounts();
-    for (size_t i = 0; i != offsets.size(); ++i)
+    const size_t numCells = offsets.size();
+
+    // cells ordered by their first offset, and their number of sections
+    std::vector<std::pair<uint64_t, uint32_t>> cells;
+    brion::size_ts cellSizes(numCells, 0);
+    cells.reserve(numCells);
+    for (size_t i = 0; i != numCells; ++i)
     {
+        uint64_t first = std::numeric_limits<uint64_t>::max();
         for (size_t j = 0; j != offsets[i].size(); ++j)
         {
-            const size_t count = counts[i][j];
-            if (count != 0)
-                mapping.push_back(std::make_tuple(offsets[i][j], i, j, count));
+            if (counts[i][j] == 0)
+                continue;
+            first = std::min<uint64_t>(first, offsets[i][j]);
+            ++cellSizes[i];
         }
+        cells.emplace_back(first, uint32_t(i));
     }
-    std::sort(mapping.begin(), mapping.end());
+    std::sort(cells.begin(), cells.end());
+
+    brion::size_ts begins(numCells + 1, 0);
+    for (size_t k = 0; k != numCells; ++k)
+        begins[k + 1] = begins[k] + cellSizes[cells[k].second];
+
+    FlatInverseMapping mapping(begins[numCells]);
+    const size_t numThreads =
+        std::max(size_t(1), std::min<size_t>(std::thread::hardware_concurrency(),
+                                             numCells));
+    std::vector<std::future<void>> tasks;
+    for (size_t t = 0; t < numThreads; ++t)
+    {
+        const size_t first = t * numCells / numThreads;
+        const size_t last = (t + 1) * numCells / numThreads;
+        tasks.push_back(std::async(std::launch::async, [&, first, last] {
+            for (size_t k = first; k < last; ++k)
+            {
+                const uint32_t i = cells[k].second;
+                auto element = mapping.begin() + begins[k];
+                for (size_t j = 0; j != offsets[i].size(); ++j)
+                {
+                    const uint16_t count = counts[i][j];
+                    if (count != 0)
+                        *element++ =
+                            std::make_tuple(offsets[i][j], i, j, count);
+                }
+                std::sort(mapping.begin() + begins[k], element);
+            }
+        }));
+    }
+    for (auto& task : tasks)
+        task.get();
+
+    // the compartments of some cells are interleaved
+    if (!std::is_sorted(mapping.begin(), mapping.end()))
+        std::sort(mapping.begin(), mapping.end());
 
 #ifdef DEBUG_INVERSE_MAPPING
     size_t offset = 0;
@@ -75,6 +148,179 @@ inline FlatInverseMapping computeInverseMapping(
     return mapping;
 }
 
+/**
+ * Computes the events of the compartments of a report in parallel.
+ *
+ * The output range of each compartment is assigned upfront with a prefix sum
+ * over the compartment counts in report mapping order, so cells can be added
+ * in any order and by multiple threads, each cell by one thread.
+ */
+class CompartmentEventBuilder
+{
+public:
+    /**
+     * @param report The report from which the compartments per section are
+     *        obtained.
+     * @param mapping The inverse mapping of the report. Must outlive the
+     *        builder.
+     * @param somasOnly Specify whether the events will be created for the
+     *        somas only or for all the compartments.
+     */
+    CompartmentEventBuilder(const brion::CompartmentReport& report,
+                            const FlatInverseMapping& mapping,
+                            const bool somasOnly)
+        : _mapping(mapping)
+        , _somasOnly(somasOnly)
+    {
+        const size_t numCells = report.getOffsets().size();
+
+        // output index of each mapping element, and the elements per cell
+        _eventOffsets.reserve(_mapping.size());
+        brion::size_ts cellCounts(numCells + 1, 0);
+        size_t size = 0;
+        for (const auto& element : _mapping)
+        {
+            _eventOffsets.push_back(size);
+            if (!somasOnly || std::get<2>(element) == 0)
+                size += std::get<3>(element);
+            ++cellCounts[std::get<1>(element) + 1];
+        }
+        _eventOffsets.push_back(size);
+
+        for (size_t i = 0; i < numCells; ++i)
+            cellCounts[i + 1] += cellCounts[i];
+        _cellOffsets = cellCounts;
+        _cellElements.resize(_mapping.size());
+        for (size_t i = 0; i < _mapping.size(); ++i)
+            _cellElements[cellCounts[std::get<1>(_mapping[i])]++] = i;
+
+        _posx.resize(size);
+        _posy.resize(size);
+        _posz.resize(size);
+        _radii.resize(size);
+    }
+
+    /** @return the number of cells in the report. */
+    size_t getNumCells() const { return _cellOffsets.size() - 1; }
+    /**
+     * Compute the events of the cells [first, last) in parallel.
+     *
+     * @param first the index of the first cell in the report mapping.
+     * @param last the index after the last cell.
+     * @param morphologies the morphologies of the cells, starting with the
+     *        morphology of the first cell.
+     */
+    void add(const size_t first, const size_t last,
+             const brain::neuron::Morphologies& morphologies)
+    {
+        const size_t numCells = last - first;
+        const size_t numThreads =
+            std::max(size_t(1),
+                     std::min<size_t>(std::thread::hardware_concurrency(),
+                                      numCells));
+        std::vector<std::future<void>> tasks;
+        for (size_t i = 0; i < numThreads; ++i)
+        {
+            const size_t begin = first + i * numCells / numThreads;
+            const size_t end = first + (i + 1) * numCells / numThreads;
+            tasks.push_back(std::async(std::launch::async, [=, &morphologies] {
+                for (size_t cell = begin; cell < end; ++cell)
+                    _addCell(cell, *morphologies[cell - first]);
+            }));
+        }
+        for (auto& task : tasks)
+            task.get();
+    }
+
+    /** Set the events of all cells added before on the output. */
+    void commit(EventSource& output) const
+    {
+        const size_t size = _posx.size();
+        output.resize(size);
+        output.setPositions(0, size, _posx.data(), _posy.data(), _posz.data());
+        output.setRadii(0, size, _radii.data());
+        output.setValues(0, size, 0.f);
+    }
+
+    /**
+     * Write the events of all cells added before to a cache file to be read
+     * by readCompartmentEvents().
+     *
+     * @return true if the file was written.
+     */
+    bool write(const std::string& path) const
+    {
+        const size_t size = _posx.size();
+        const EventCacheHeader header = {EventCacheHeader::currentMagic,
+                                         EventCacheHeader::currentVersion,
+                                         size};
+        const size_t bytes = size * sizeof(float);
+        return cache::write(path, {cache::Block(&header, sizeof(header)),
+                                   cache::Block(_posx.data(), bytes),
+                                   cache::Block(_posy.data(), bytes),
+                                   cache::Block(_posz.data(), bytes),
+                                   cache::Block(_radii.data(), bytes)});
+    }
+
+private:
+    void _addCell(const size_t cell,
+                  const brain::neuron::Morphology& morphology)
+    {
+        for (size_t i = _cellOffsets[cell]; i < _cellOffsets[cell + 1]; ++i)
+        {
+            const size_t element = _cellElements[i];
+            const uint32_t sectionId = std::get<2>(_mapping[element]);
+            const uint16_t compartments = std::get<3>(_mapping[element]);
+            const size_t index = _eventOffsets[element];
+            float* posx = _posx.data() + index;
+            float* posy = _posy.data() + index;
+            float* posz = _posz.data() + index;
+            float* radii = _radii.data() + index;
+
+            if (sectionId == 0)
+            {
+                const auto& soma = morphology.getSoma();
+                const Vector3f& centroid = soma.getCentroid();
+                std::fill(posx, posx + compartments, centroid[0]);
+                std::fill(posy, posy + compartments, centroid[1]);
+                std::fill(posz, posz + compartments, centroid[2]);
+                std::fill(radii, radii + compartments, soma.getMeanRadius());
+                continue;
+            }
+
+            if (_somasOnly)
+                continue;
+
+            // centers of the compartments in normalized section length
+            const float normLength = 1.f / float(compartments);
+            brion::floats samples(compartments);
+            for (size_t k = 0; k < compartments; ++k)
+                samples[k] = (k + .5f) * normLength;
+
+            const auto& neuronSection = morphology.getSection(sectionId);
+
+            // actual compartment length
+            const float radius = normLength * neuronSection.getLength() * .2f;
+
+            const auto& points = neuronSection.getSamples(samples);
+            for (size_t k = 0; k < compartments; ++k)
+            {
+                posx[k] = points[k][0];
+                posy[k] = points[k][1];
+                posz[k] = points[k][2];
+                radii[k] = radius;
+            }
+        }
+    }
+
+    const FlatInverseMapping& _mapping;
+    const bool _somasOnly;
+    brion::size_ts _eventOffsets; // output index of each mapping element
+    brion::size_ts _cellOffsets;  // cell i has _cellElements[i, i+1)
+    brion::size_ts _cellElements; // mapping elements sorted by cell
+    brion::floats _posx, _posy, _posz, _radii;
+};
+
 /**
  * Add one event per simulation compartment to the given event source.
  * The compartment counts are obtained from the report mapping. The event
@@ -84,8 +330,8 @@ inline FlatInverseMapping computeInverseMapping(
  *        index must correspond to the cell at the same index in the report
  *        mapping.
  * @param report The report from which the compartments per section are obtained
- * @param output The output event source. Events are added in the morphology
- *        iteration order, starting with the soma and then all the dendrites.
+ * @param output The output event source. Events are added in the report
+ *        mapping order.
  * @param somasOnly Specify whether the events will be created for the somas
  *        only or for all the compartments. False by default (load all).
  */
@@ -94,68 +340,446 @@ inline void addCompartmentEvents(
     const brion::CompartmentReport& report, EventSource& output,
     const bool somasOnly = false)
 {
-    size_t size = 0;
-    const auto& mapping = computeInverseMapping(report);
-    // first loop over the mapping to compute the number of elements
-    for (const auto& i : mapping)
+    const FlatInverseMapping& mapping = computeInverseMapping(report);
+    CompartmentEventBuilder builder(report, mapping, somasOnly);
+    builder.add(0, builder.getNumCells(), morphologies);
+    builder.commit(output);
+}
+
+/**
+ * Compute the events of all report cells with the given builder.
+ *
+ * The morphologies are loaded in batches of cells, the next batch in the
+ * background while the events of the current one are computed.
+ *
+ * @param circuit The circuit of the report cells.
+ * @param report The report of the builder.
+ * @param builder The builder computing the events.
+ */
+inline void buildCompartmentEvents(const brain::Circuit& circuit,
+                                   const brion::CompartmentReport& report,
+                                   CompartmentEventBuilder& builder)
+{
+    static const size_t batchSize = 1024; // cells per morphology load
+
+    const std::vector<uint32_t> gids(report.getGIDs().begin(),
+                                     report.getGIDs().end());
+    const size_t numCells = std::min(builder.getNumCells(), gids.size());
+
+    const auto loadBatch = [&](const size_t first) {
+        const brion::GIDSet batch(gids.begin() + first,
+                                  gids.begin() +
+                                      std::min(first + batchSize, numCells));
+        return std::async(std::launch::async, [&circuit, batch] {
+            return circuit.loadMorphologies(
+                batch, brain::Circuit::Coordinates::global);
+        });
+    };
+
+    std::future<brain::neuron::Morphologies> next = loadBatch(0);
+    for (size_t first = 0; first < numCells; first += batchSize)
     {
-        size_t offset;
-        uint32_t cellIndex;
-        uint32_t sectionId;
-        uint16_t compartments;
-        std::tie(offset, cellIndex, sectionId, compartments) = i;
+        const brain::neuron::Morphologies& morphologies = next.get();
+        const size_t last = std::min(first + batchSize, numCells);
+        if (last < numCells)
+            next = loadBatch(last);
+        builder.add(first, last, morphologies);
+    }
+}
 
-        if (somasOnly && sectionId != 0)
-            continue;
+/**
+ * Add one event per simulation compartment to the given event source, loading
+ * the morphologies of the report cells from the circuit.
+ *
+ * @param circuit The circuit of the report cells.
+ * @param report The report from which the compartments per section are
+ *        obtained.
+ * @param output The output event source. Events are added in the report
+ *        mapping order.
+ * @param somasOnly Specify whether the events will be created for the somas
+ *        only or for all the compartments. False by default (load all).
+ */
+inline void addCompartmentEvents(const brain::Circuit& circuit,
+                                 const brion::CompartmentReport& report,
+                                 EventSource& output,
+                                 const bool somasOnly = false)
+{
+    const FlatInverseMapping& mapping = computeInverseMapping(report);
+    CompartmentEventBuilder builder(report, mapping, somasOnly);
+    buildCompartmentEvents(circuit, report, builder);
+    builder.commit(output);
+}
 
-        size += compartments;
+/**
+ * Set the events from a cache file written by CompartmentEventBuilder::write().
+ *
+ * @param path the cache file.
+ * @param output The output event source.
+ * @return false if the file does not exist or is not a valid cache file, in
+ *         which case the output is unchanged.
+ */
+inline bool readCompartmentEvents(const std::string& path, EventSource& output)
+{
+    if (!cache::exists(path))
+        return false;
+
+    const lunchbox::MemoryMap file(path);
+    const EventCacheHeader* header = file.getAddress<EventCacheHeader>();
+    const size_t fileSize = file.getSize();
+    if (!header || fileSize < sizeof(EventCacheHeader) ||
+        header->magic != EventCacheHeader::currentMagic ||
+        header->version != EventCacheHeader::currentVersion ||
+        fileSize < sizeof(EventCacheHeader) +
+                       4 * header->numEvents * sizeof(float))
+    {
+        LBWARN << "Ignoring invalid event cache " << path << std::endl;
+        return false;
     }
+
+    // copied instead of adopted: the event source keeps the positions and the
+    // inverted radii in one allocation per buffer and computes the bounding
+    // box while copying the positions
+    const size_t size = header->numEvents;
+    const float* x = reinterpret_cast<const float*>(header + 1);
     output.resize(size);
+    output.setPositions(0, size, x, x + size, x + 2 * size);
+    output.setRadii(0, size, x + 3 * size);
+    output.setValues(0, size, 0.f);
+    LBINFO << "Using event cache " << path << std::endl;
+    return true;
+}
 
-    size_t index = 0;
-    // second loop to add the actual events
+/**
+ * Add one event per simulation compartment to the given event source, using
+ * the events cached on disk by an earlier run if possible.
+ *
+ * The cache is keyed by the circuit and morphology files, the report cells and
+ * the report mapping, so a hit skips the morphology loading entirely.
+ * Otherwise the events are created as by
+ * addCompartmentEvents(circuit, report, output, somasOnly) and written to the
+ * cache.
+ *
+ * @param params the URI parameters, for the circuit and the cache settings.
+ * @param circuit The circuit of the report cells.
+ * @param report The report from which the compartments per section are
+ *        obtained.
+ * @param mapping The inverse mapping of the report.
+ * @param output The output event source. Events are added in the report
+ *        mapping order.
+ * @param somasOnly Specify whether the events will be created for the somas
+ *        only or for all the compartments. False by default (load all).
+ */
+inline void addCompartmentEvents(const URIHandler& params,
+                                 const brain::Circuit& circuit,
+                                 const brion::CompartmentReport& report,
+                                 const FlatInverseMapping& mapping,
+                                 EventSource& output,
+                                 const bool somasOnly = false)
+{
+    cache::Key key;
+    key << std::string("compartmentEvents") << params.getConfigPath()
+        << report.getGIDs() << uint64_t(somasOnly);
+    for (const auto& offsets : report.getOffsets())
+        key << offsets;
+    for (const auto& counts : report.getCompartmentCounts())
+        key << counts;
+    key.addFile(params.getConfigPath())
+        .addFile(params.getConfig().getCircuitSource().getPath());
+    for (const auto& uri : circuit.getMorphologyURIs(report.getGIDs()))
+        key.addFile(uri.getPath());
+
+    const std::string& path = cache::getPath(params, "events", key);
+    if (readCompartmentEvents(path, output))
+        return;
+
+    CompartmentEventBuilder builder(report, mapping, somasOnly);
+    buildCompartmentEvents(circuit, report, builder);
+    builder.commit(output);
+    if (!path.empty() && builder.write(path))
+        LBINFO << "Wrote event cache " << path << std::endl;
+}
+
+/**
+ * Compute the group of each cell for grouped voxelization.
+ *
+ * @param circuit the circuit of the cells.
+ * @param gids the cells to group.
+ * @param groupBy 'mtype' to group by morphological type, 'layer' to group by
+ *        the layer prefix of the morphological type, e.g. 'L23' for
+ *        'L23_PC'.
+ * @param names returns the names of the groups.
+ * @return the group index of each cell, in GID order.
+ * @throw std::runtime_error if groupBy is not supported.
+ */
+inline brion::uint16_ts computeCellGroups(const brain::Circuit& circuit,
+                                          const brion::GIDSet& gids,
+                                          const std::string& groupBy,
+                                          brion::Strings& names)
+{
+    if (groupBy != "mtype" && groupBy != "layer")
+        LBTHROW(std::runtime_error("Unsupported groupBy '" + groupBy +
+                                   "' for cell reports"));
+
+    const brion::Strings& mtypeNames = circuit.getMorphologyTypeNames();
+    const brion::size_ts& mtypes = circuit.getMorphologyTypes(gids);
+
+    // only the groups of the given cells, in order of appearance
+    std::map<std::string, uint16_t> groupIndices;
+    brion::uint16_ts groups;
+    groups.reserve(mtypes.size());
+    names.clear();
+    for (const size_t mtype : mtypes)
+    {
+        std::string name = mtypeNames[mtype];
+        if (groupBy == "layer")
+            name = name.substr(0, name.find('_'));
+
+        const auto i = groupIndices.emplace(name, uint16_t(names.size()));
+        if (i.second)
+            names.push_back(name);
+        groups.push_back(i.first->second);
+    }
+    return groups;
+}
+
+/**
+ * Set the groups of the events added by addCompartmentEvents() from the
+ * groups of their cells.
+ *
+ * @param cellGroups the group of each cell, in report mapping order.
+ * @param names the names of the groups.
+ * @param mapping the inverse mapping of the report used in
+ *        addCompartmentEvents().
+ * @param output the output event source.
+ * @param somasOnly as used in addCompartmentEvents().
+ */
+inline void addCompartmentGroups(const brion::uint16_ts& cellGroups,
+                                 const brion::Strings& names,
+                                 const FlatInverseMapping& mapping,
+                                 EventSource& output,
+                                 const bool somasOnly = false)
+{
+    brion::uint16_ts groups;
+    groups.reserve(output.getNumEvents());
     for (const auto& i : mapping)
     {
-        size_t offset;
-        uint32_t cellIndex;
-        uint32_t sectionId;
-        uint16_t compartments;
-        std::tie(offset, cellIndex, sectionId, compartments) = i;
+        const uint32_t cellIndex = std::get<1>(i);
+        const uint32_t sectionId = std::get<2>(i);
+        if (somasOnly && sectionId != 0)
+            continue;
+        groups.insert(groups.end(), std::get<3>(i), cellGroups[cellIndex]);
+    }
 
-        const auto& morphology = *morphologies[cellIndex];
+    output.setGroupNames(names);
+    output.setGroups(0, groups.size(), groups.data());
+}
 
-        if (sectionId == 0)
-        {
-            const auto& soma = morphology.getSoma();
-            for (size_t k = 0; k != compartments; ++k)
-                output.update(index++, soma.getCentroid(),
-                              soma.getMeanRadius());
+/**
+ * Find the cells with events in a region of interest.
+ *
+ * @param region the region of interest.
+ * @param report the report used in addCompartmentEvents().
+ * @param mapping the inverse mapping of the report.
+ * @param events the events created by addCompartmentEvents().
+ * @param somasOnly as used in addCompartmentEvents().
+ * @return the GIDs of the report cells with at least one event in the region.
+ */
+inline brion::GIDSet findCellsInRegion(const AABBf& region,
+                                       const brion::CompartmentReport& report,
+                                       const FlatInverseMapping& mapping,
+                                       const EventSource& events,
+                                       const bool somasOnly = false)
+{
+    const float* posx = events.getPositionsX();
+    const float* posy = events.getPositionsY();
+    const float* posz = events.getPositionsZ();
+    std::vector<bool> inside(report.getGIDs().size(), false);
+    size_t index = 0;
+    for (const auto& element : mapping)
+    {
+        const uint32_t cellIndex = std::get<1>(element);
+        if (somasOnly && std::get<2>(element) != 0)
             continue;
+        for (size_t k = 0; k < std::get<3>(element); ++k, ++index)
+        {
+            if (!inside[cellIndex] &&
+                region.isIn(Vector3f(posx[index], posy[index], posz[index])))
+            {
+                inside[cellIndex] = true;
+            }
         }
+    }
 
-        if (somasOnly)
+    brion::GIDSet gids;
+    size_t cellIndex = 0;
+    for (const uint32_t gid : report.getGIDs())
+        if (inside[cellIndex++])
+            gids.insert(gids.end(), gid);
+    return gids;
+}
+
+/**
+ * Restrict the events created by addCompartmentEvents() to the cells of a
+ * report opened with a subset of the cells, e.g. from findCellsInRegion().
+ *
+ * The events are rearranged into the mapping order of the subset report
+ * instead of being recomputed from the morphologies.
+ *
+ * @param report the report used in addCompartmentEvents().
+ * @param mapping the inverse mapping of the report.
+ * @param subset the report of the subset of the cells.
+ * @param subsetMapping the inverse mapping of the subset.
+ * @param output the events created by addCompartmentEvents().
+ * @param somasOnly as used in addCompartmentEvents().
+ * @throw std::runtime_error if a section of the subset is not in the report.
+ */
+inline void selectCompartmentEvents(const brion::CompartmentReport& report,
+                                    const FlatInverseMapping& mapping,
+                                    const brion::CompartmentReport& subset,
+                                    const FlatInverseMapping& subsetMapping,
+                                    EventSource& output,
+                                    const bool somasOnly = false)
+{
+    const auto getKey = [](const uint32_t gid, const uint32_t sectionId) {
+        return uint64_t(gid) << 32 | sectionId;
+    };
+
+    // first event of each section of the report
+    std::unordered_map<uint64_t, size_t> firstEvents;
+    const std::vector<uint32_t> gids(report.getGIDs().begin(),
+                                     report.getGIDs().end());
+    size_t index = 0;
+    for (const auto& element : mapping)
+    {
+        const uint32_t sectionId = std::get<2>(element);
+        if (somasOnly && sectionId != 0)
             continue;
+        firstEvents[getKey(gids[std::get<1>(element)], sectionId)] = index;
+        index += std::get<3>(element);
+    }
 
-        brion::floats samples;
-        samples.reserve(compartments);
-        // normalized compartment length
-        const float normLength = 1.f / float(compartments);
-        for (float k = normLength * .5f; k < 1.0; k += normLength)
-            samples.push_back(k);
+    const std::vector<uint32_t> subsetGIDs(subset.getGIDs().begin(),
+                                           subset.getGIDs().end());
+    brion::size_ts indices;
+    for (const auto& element : subsetMapping)
+    {
+        const uint32_t gid = subsetGIDs[std::get<1>(element)];
+        const uint32_t sectionId = std::get<2>(element);
+        if (somasOnly && sectionId != 0)
+            continue;
+        const auto first = firstEvents.find(getKey(gid, sectionId));
+        if (first == firstEvents.end())
+            LBTHROW(std::runtime_error("Section " + std::to_string(sectionId) +
+                                       " of cell " + std::to_string(gid) +
+                                       " has no events"));
+        for (size_t k = 0; k < std::get<3>(element); ++k)
+            indices.push_back(first->second + k);
+    }
+    output.selectEvents(indices);
+}
+
+/**
+ * Restrict the events created by addCompartmentEvents() to the cells with
+ * events in a region of interest.
+ *
+ * @param region the region of interest.
+ * @param source the URI of the report.
+ * @param report the report used in addCompartmentEvents().
+ * @param mapping the inverse mapping of the report, replaced by the mapping of
+ *        the returned report if any.
+ * @param output the events created by addCompartmentEvents().
+ * @param somasOnly as used in addCompartmentEvents().
+ * @return the report opened for the cells in the region, to read the values of
+ *         the remaining events from. nullptr if all cells are in the region
+ *         and the events are unchanged, or if no cell is in the region and no
+ *         event is left.
+ */
+inline std::unique_ptr<brion::CompartmentReport> selectCellsInRegion(
+    const AABBf& region, const URI& source,
+    const brion::CompartmentReport& report, FlatInverseMapping& mapping,
+    EventSource& output, const bool somasOnly = false)
+{
+    std::unique_ptr<brion::CompartmentReport> regionReport;
+    if (output.getNumEvents() == 0)
+        return regionReport;
 
-        const auto& neuronSection = morphology.getSection(sectionId);
+    const brion::GIDSet& gids =
+        findCellsInRegion(region, report, mapping, output, somasOnly);
+    if (gids.size() == report.getGIDs().size())
+        return regionReport;
 
-        // actual compartment length
-        const float compartmentLength = normLength * neuronSection.getLength();
+    LBINFO << "Loading " << gids.size() << " of " << report.getGIDs().size()
+           << " cells in the region of interest" << std::endl;
 
-        const auto& points = neuronSection.getSamples(samples);
-        for (const auto& point : points)
-        {
-            output.update(index++, point.get_sub_vector<3, 0>(),
-                          compartmentLength * .2f);
-        }
+    // an empty GID set would open the report for all cells
+    if (gids.empty())
+    {
+        output.selectEvents(brion::size_ts());
+        return regionReport;
     }
+
+    regionReport.reset(
+        new brion::CompartmentReport(source, brion::MODE_READ, gids));
+    FlatInverseMapping regionMapping = computeInverseMapping(*regionReport);
+    selectCompartmentEvents(report, mapping, *regionReport, regionMapping,
+                            output, somasOnly);
+    mapping.swap(regionMapping);
+    return regionReport;
 }
+
+/**
+ * Reads frames of a compartment report, with a read-ahead of a few frames in
+ * the background to overlap I/O with voxelization.
+ *
+ * The pending reads are kept per time, so prefetching the next frame does not
+ * discard the pending read of the current one.
+ */
+template <class Report = brion::CompartmentReport>
+class FrameReader
+{
+public:
+    /** The maximum number of pending reads, the oldest one is dropped */
+    static const size_t maxPrefetched = 2;
+
+    explicit FrameReader(Report& report)
+        : _report(&report)
+    {
+    }
+
+    /** Read the frames from another report, discarding pending prefetches. */
+    void setReport(Report& report)
+    {
+        _prefetched.clear(); // waits for the pending reads
+        _report = &report;
+    }
+
+    /** Start reading the frame at the given time in the background. */
+    void prefetch(const double time)
+    {
+        if (_prefetched.count(time) > 0)
+            return;
+
+        if (_prefetched.size() >= maxPrefetched)
+            _prefetched.erase(_prefetched.begin());
+        _prefetched[time] = _report->loadFrame(time);
+    }
+
+    /** @return the frame at the given time, prefetched if available. */
+    brion::floatsPtr load(const double time)
+    {
+        const auto i = _prefetched.find(time);
+        if (i == _prefetched.end())
+            return _report->loadFrame(time).get();
+
+        std::future<brion::floatsPtr> frame = std::move(i->second);
+        _prefetched.erase(i);
+        return frame.get();
+    }
+
+private:
+    Report* _report;
+    std::map<double, std::future<brion::floatsPtr>> _prefetched;
+};
 }
 }
 #endif
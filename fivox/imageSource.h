@@ -65,13 +65,22 @@ public:
                         ImageType::ImageDimension);
 
     /** Set the event source that is used for sampling into the volume. */
-    FIVOX_API void setEventSource(EventSourcePtr source)
+    FIVOX_API virtual void setEventSource(EventSourcePtr source)
     {
         _eventSource = source;
     }
 
     /** @return the event source used for sampling. */
     FIVOX_API EventSourcePtr getEventSource() { return _eventSource; }
+
+    /**
+     * Load the events of the current time of the event source on each update
+     * (default: true). Disable it to sample events loaded by the caller, e.g.
+     * to update several image sources sharing one event source concurrently.
+     * Ignored by image sources loading several chunks of events themselves,
+     * like the EventValueSummationImageSource for synapses.
+     */
+    FIVOX_API void setLoadEvents(const bool enable) { _loadEvents = enable; }
     /**
      * Setup size and resolution of output volume depending on user input.
      *
@@ -91,6 +100,16 @@ public:
     /** @return the resolution of the output volume in voxels per micrometer. */
     FIVOX_API const Vector3f& getResolution() const;
 
+    /**
+     * @return the number of output channels, one per event group or 1 if the
+     *         events are not grouped. Channel i is GetOutput(i) and has the
+     *         size, spacing and origin of GetOutput().
+     */
+    FIVOX_API size_t getNumChannels() const;
+
+    /** @return the name of the given channel, empty if not grouped. */
+    FIVOX_API std::string getChannelName(size_t channel) const;
+
 protected:
     ImageSource();
     ImageSource(const Self&) = delete;
@@ -98,8 +117,12 @@ protected:
 
     void PrintSelf(std::ostream& os, itk::Indent indent) const override;
 
+    /** Copy the information of the first output to the other channels. */
+    void GenerateOutputInformation() override;
+
     EventSourcePtr _eventSource;
     ProgressObserver::Pointer _progressObserver;
+    bool _loadEvents;
 
     AABBf _boundingBox;
     Vector3ui _sizeVoxel;
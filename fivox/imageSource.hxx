@@ -21,6 +21,7 @@
 #ifndef FIVOX_IMAGESOURCE_HXX
 #define FIVOX_IMAGESOURCE_HXX
 
+#include "eventSource.h"
 #include "imageSource.h"
 #include "uriHandler.h"
 
@@ -33,6 +34,7 @@ namespace fivox
 {
 template< typename TImage > ImageSource< TImage >::ImageSource()
     : _progressObserver( ProgressObserver::New( ))
+    , _loadEvents( true )
 {
     // set up default size
     static const size_t size = 256;
@@ -54,11 +56,28 @@ void ImageSource< TImage >::PrintSelf(std::ostream & os, itk::Indent indent )
     Superclass::PrintSelf( os, indent );
 }
 
+template< typename TImage >
+void ImageSource< TImage >::GenerateOutputInformation()
+{
+    Superclass::GenerateOutputInformation();
+
+    const ImagePointer first = Superclass::GetOutput( 0 );
+    for( size_t i = 1; i < getNumChannels(); ++i )
+        Superclass::GetOutput( i )->CopyInformation( first );
+}
+
 template< typename TImage >
 void ImageSource< TImage >::setup( const URIHandler& params )
 {
     _progressObserver->enablePrint();
 
+    // one output per event group, all computed in one pass over the events
+    const size_t numChannels =
+        std::max( size_t( 1 ), _eventSource->getNumGroups( ));
+    Superclass::SetNumberOfRequiredOutputs( numChannels );
+    for( size_t i = 1; i < numChannels; ++i )
+        Superclass::SetNthOutput( i, Superclass::MakeOutput( i ));
+
     const std::string& refVolume = params.getReferenceVolume();
     if( refVolume.empty( ))
     {
@@ -128,6 +147,20 @@ const Vector3f& ImageSource< TImage >::getResolution() const
     return _resolution;
 }
 
+template< typename TImage >
+size_t ImageSource< TImage >::getNumChannels() const
+{
+    return Superclass::GetNumberOfIndexedOutputs();
+}
+
+template< typename TImage >
+std::string ImageSource< TImage >::getChannelName( const size_t channel ) const
+{
+    if( !_eventSource || channel >= _eventSource->getNumGroups( ))
+        return std::string();
+    return _eventSource->getGroupNames()[channel];
+}
+
 } // end namespace fivox
 
 #endif
@@ -0,0 +1,198 @@
+/* Copyright (c) 2017, EPFL/Blue Brain Project
+ *
+ * This file is part of Fivox <https://github.com/BlueBrain/Fivox>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef FIVOX_LFPFUNCTOR_H
+#define FIVOX_LFPFUNCTOR_H
+
+#include <fivox/api.h>
+#include <fivox/eventFunctor.h> // base class
+#include <fivox/eventSource.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace fivox
+{
+/**
+ * Samples the local field potential in mV of the compartment currents in mA.
+ *
+ * Each event within the cutoff distance adds value * min(1 / radius,
+ * 1 / distance) / (4 * PI * conductivity), with a conductivity of 1 / 3.54
+ * siemens per meter, like the kernel of the CUDA image source.
+ *
+ * The voxels of a row are sampled together: the events are traversed in blocks
+ * fitting into the L1 cache, and the events of a block farther than the cutoff
+ * distance from the row are skipped for all its voxels.
+ */
+template <typename TImage>
+class LFPFunctor : public EventFunctor<TImage>
+{
+    typedef EventFunctor<TImage> Super;
+    typedef typename Super::TPixel TPixel;
+    typedef typename Super::TPoint TPoint;
+    typedef typename Super::TSpacing TSpacing;
+
+public:
+    FIVOX_API LFPFunctor()
+        : Super()
+    {
+    }
+    FIVOX_API virtual ~LFPFunctor() {}
+    FIVOX_API TPixel operator()(const TPoint& point,
+                                const TSpacing& spacing) const override;
+    FIVOX_API bool supportsRows() const override { return true; }
+    FIVOX_API bool sampleRow(const TPoint& first, const TSpacing& spacing,
+                             size_t count, TPixel* pixels) const override;
+
+private:
+    enum
+    {
+        _blockSize = 1024, // events per block, 20 KB of event data
+        _numLanes = 8      // independent sums, vectorized by the compiler
+    };
+
+    void _sample(const TPoint& first, float step, size_t count,
+                 float* currents) const;
+};
+
+template <class TImage>
+inline typename LFPFunctor<TImage>::TPixel LFPFunctor<TImage>::operator()(
+    const TPoint& point, const TSpacing&) const
+{
+    float current;
+    _sample(point, 0.f, 1, &current);
+    return current;
+}
+
+template <class TImage>
+inline bool LFPFunctor<TImage>::sampleRow(const TPoint& first,
+                                          const TSpacing& spacing,
+                                          const size_t count,
+                                          TPixel* pixels) const
+{
+    std::vector<float> currents(count);
+    _sample(first, spacing[0], count, currents.data());
+    std::copy(currents.begin(), currents.end(), pixels);
+    return true;
+}
+
+template <class TImage>
+inline void LFPFunctor<TImage>::_sample(const TPoint& first, const float step,
+                                        const size_t count,
+                                        float* __restrict__ currents) const
+{
+    std::fill(currents, currents + count, 0.f);
+    if (!Super::_source)
+        return;
+
+    const EventSource& source = *Super::_source;
+    const size_t numEvents = source.getNumEvents();
+    const float* __restrict__ posx = source.getPositionsX();
+    const float* __restrict__ posy = source.getPositionsY();
+    const float* __restrict__ posz = source.getPositionsZ();
+    const float* __restrict__ radii = source.getRadii();
+    const float* __restrict__ values = source.getValues();
+
+    const float px(first[0]), py(first[1]), pz(first[2]);
+    const float cutOffDistance = source.getCutOffDistance();
+    const float squaredCutoff = cutOffDistance * cutOffDistance;
+    // Compute directly the inverted value to gain performance in the loop
+    const float invCutoff = 1.f / cutOffDistance;
+
+    // the events of the current block near the row, with their squared
+    // distance to the row in the y-z plane
+    float eventX[_blockSize], eventYZ[_blockSize];
+    float eventRadius[_blockSize], eventValue[_blockSize];
+    float eventCurrent[_blockSize];
+
+    for (size_t begin = 0; begin < numEvents; begin += _blockSize)
+    {
+        const size_t end = std::min<size_t>(begin + _blockSize, numEvents);
+        size_t size = 0;
+        for (size_t i = begin; i < end; ++i)
+        {
+            const float distanceY = py - posy[i];
+            const float distanceZ = pz - posz[i];
+            const float distanceYZ =
+                distanceY * distanceY + distanceZ * distanceZ;
+            if (distanceYZ > squaredCutoff)
+                continue;
+
+            eventX[size] = posx[i];
+            eventYZ[size] = distanceYZ;
+            eventRadius[size] = radii[i];
+            eventValue[size] = values[i];
+            ++size;
+        }
+        if (size == 0)
+            continue;
+
+        // pad to full lanes with events without contribution
+        for (; size % _numLanes != 0; ++size)
+        {
+            eventX[size] = px;
+            eventYZ[size] = 0.f;
+            eventRadius[size] = 0.f;
+            eventValue[size] = 0.f;
+        }
+
+        for (size_t k = 0; k < count; ++k)
+        {
+            const float x = px + k * step;
+            for (size_t i = 0; i < size; ++i)
+            {
+                const float distanceX = x - eventX[i];
+                const float distance2 = distanceX * distanceX + eventYZ[i];
+
+                // Use the reciprocal of sqrt
+                const float length = 1.f / std::sqrt(distance2);
+
+                // If center of the voxel within the event radius, use the
+                // current at the surface of the compartment (radius is
+                // already inverted from the loader)
+                const float current =
+                    eventValue[i] * std::min(eventRadius[i], length);
+
+                // Comparison is inverted, as we are using the reciprocal
+                // values
+                eventCurrent[i] = length < invCutoff ? 0.f : current; // mA
+            }
+
+            float lanes[_numLanes] = {0.f};
+            for (size_t j = 0; j < size; j += _numLanes)
+                for (size_t l = 0; l < _numLanes; ++l)
+                    lanes[l] += eventCurrent[j + l];
+
+            float current = 0.f;
+            for (size_t l = 0; l < _numLanes; ++l)
+                current += lanes[l];
+            currents[k] += current;
+        }
+    }
+
+    // voltageFactor =  1 / (4 * PI * conductivity),
+    // with conductivity = 1 / 3.54 (siemens per meter)
+    const float voltageFactor = 0.281704249f;
+    // output voltage in mV
+    for (size_t k = 0; k < count; ++k)
+        currents[k] *= voltageFactor;
+}
+}
+
+#endif
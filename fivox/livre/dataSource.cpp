@@ -20,7 +20,9 @@
 
 #include "dataSource.h"
 
+#include <fivox/cache.h>
 #include <fivox/eventFunctor.h>
+#include <fivox/eventLOD.h>
 #include <fivox/helpers.h>
 #include <fivox/imageSource.h>
 #include <fivox/scaleFilter.h>
@@ -31,9 +33,16 @@
 #include <livre/data/version.h>
 
 #include <lunchbox/pluginRegisterer.h>
-#include <lunchbox/scopedMutex.h>
 #include <lunchbox/string.h>
 
+#include <algorithm>
+#include <condition_variable>
+#include <fstream>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
 extern "C" int LunchboxPluginGetVersion()
 {
     return LIVREDATA_VERSION_ABI;
@@ -46,26 +55,290 @@ extern "C" bool LunchboxPluginRegister()
 
 namespace fivox
 {
+namespace
+{
+/** An image source and the scale filter of its output */
+struct Pipeline
+{
+    Pipeline(const URIHandler& params, EventSourcePtr loader)
+        : source(params.newImageSource<FloatVolume>(loader))
+        , scaler(source->GetOutput(), params.getInputRange())
+    {
+    }
+
+    void setNumberOfThreads(const size_t numThreads)
+    {
+        source->SetNumberOfThreads(numThreads);
+        scaler.SetNumberOfThreads(numThreads);
+    }
+
+    ImageSourcePtr<FloatVolume> source;
+    ScaleFilter<ByteVolume> scaler;
+};
+typedef std::unique_ptr<Pipeline> PipelinePtr;
+
+typedef std::vector<uint8_t> Brick;
+typedef std::shared_ptr<const Brick> BrickPtr;
+
+/**
+ * @return the key of the data sampled for the given URI, with the files read
+ *         by its event source, so bricks of changed data are not read back
+ */
+cache::Key _getDataKey(const URIHandler& params, const std::string& uri)
+{
+    cache::Key key;
+    key << std::string("brick") << uri;
+    if (params.getConfigPath().empty())
+        return key;
+
+    const brion::BlueConfig& config = params.getConfig();
+    key.addFile(params.getConfigPath())
+        .addFile(config.getCircuitSource().getPath());
+    switch (params.getType())
+    {
+    case VolumeType::compartments:
+    case VolumeType::somas:
+    case VolumeType::vsd:
+        key.addFile(config.getReportSource(params.getReport()).getPath());
+        break;
+    case VolumeType::spikes:
+    {
+        const std::string& spikes = params.getSpikes();
+        key.addFile(spikes.empty() ? config.getSpikeSource().getPath()
+                                   : spikes);
+        break;
+    }
+    case VolumeType::synapses:
+        key.addFile(config.getSynapseSource().getPath());
+        break;
+    default:
+        break;
+    }
+    return key;
+}
+
+/**
+ * LRU cache of sampled bricks with a memory budget. Evicted bricks are written
+ * to a local directory, if given, and read back from it when requested again.
+ * The directory is trimmed to the cacheSize URI parameter. Thread safe.
+ */
+class BrickCache
+{
+public:
+    BrickCache(const URIHandler& params, const std::string& uri)
+        : _dataKey(_getDataKey(params, uri))
+        , _dir(params.getBrickCacheDir())
+        , _maxSize(params.getBrickCacheSize())
+        , _maxDiskSize(params.getCacheSize())
+        , _size(0)
+        , _written(0)
+    {
+        if (!_dir.empty())
+            cache::trim(_dir, _maxDiskSize);
+    }
+
+    ~BrickCache()
+    {
+        if (_stats.hits + _stats.diskHits + _stats.misses > 0)
+            LBINFO << "Brick cache: " << _stats.hits << " hits, "
+                   << _stats.diskHits << " hits on disk, " << _stats.misses
+                   << " misses" << std::endl;
+    }
+
+    DataSource::BrickCacheStatistics getStatistics() const
+    {
+        const std::lock_guard<std::mutex> lock(_mutex);
+        return _stats;
+    }
+
+    bool isEnabled() const { return _maxSize > 0 || !_dir.empty(); }
+
+    /** @return the brick of the given node id and size, or nullptr */
+    BrickPtr get(const uint64_t id, const size_t size)
+    {
+        std::string path;
+        {
+            const std::lock_guard<std::mutex> lock(_mutex);
+            const auto i = _index.find(id);
+            if (i != _index.end())
+            {
+                _lru.splice(_lru.begin(), _lru, i->second);
+                ++_stats.hits;
+                return i->second->brick;
+            }
+            path = _getPath(id, size);
+        }
+
+        if (cache::exists(path))
+        {
+            std::shared_ptr<Brick> brick = std::make_shared<Brick>(size);
+            std::ifstream file(path, std::ios::binary);
+            if (file.read(reinterpret_cast<char*>(brick->data()), size) &&
+                file.peek() == std::ifstream::traits_type::eof())
+            {
+                _insert(id, brick, true);
+                const std::lock_guard<std::mutex> lock(_mutex);
+                ++_stats.diskHits;
+                return brick;
+            }
+            LBWARN << "Ignoring invalid brick cache file " << path
+                   << std::endl;
+        }
+
+        const std::lock_guard<std::mutex> lock(_mutex);
+        ++_stats.misses;
+        return BrickPtr();
+    }
+
+    /** Add the sampled brick of the given node id */
+    void put(const uint64_t id, const BrickPtr& brick)
+    {
+        _insert(id, brick, false);
+    }
+
+    /** Drop the cached bricks if the frame range of the data changed */
+    void setFrameRange(const Vector2ui& frameRange)
+    {
+        const std::lock_guard<std::mutex> lock(_mutex);
+        if (frameRange == _frameRange)
+            return;
+        _frameRange = frameRange;
+        _lru.clear();
+        _index.clear();
+        _size = 0;
+    }
+
+private:
+    struct Entry
+    {
+        uint64_t id;
+        BrickPtr brick;
+        bool onDisk;
+    };
+
+    const cache::Key _dataKey;
+    const std::string _dir;
+    const size_t _maxSize;     // bytes
+    const size_t _maxDiskSize; // bytes
+    mutable std::mutex _mutex;
+    std::list<Entry> _lru; // most recently used first
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> _index;
+    size_t _size; // bytes
+    Vector2ui _frameRange;
+    DataSource::BrickCacheStatistics _stats;
+    size_t _written; // bytes written to _dir since it was trimmed
+
+    std::string _getPath(const uint64_t id, const size_t size) const
+    {
+        if (_dir.empty())
+            return std::string();
+
+        cache::Key key = _dataKey;
+        key << id << uint64_t(size) << uint64_t(_frameRange[0])
+            << uint64_t(_frameRange[1]);
+        return cache::getPath(_dir, "brick", key);
+    }
+
+    void _insert(const uint64_t id, const BrickPtr& brick, const bool onDisk)
+    {
+        // bricks evicted to disk, written after unlocking
+        std::vector<std::pair<std::string, BrickPtr>> evicted;
+        {
+            const std::lock_guard<std::mutex> lock(_mutex);
+            if (_index.count(id) > 0) // sampled concurrently
+                return;
+
+            _lru.push_front(Entry{id, brick, onDisk});
+            _index[id] = _lru.begin();
+            _size += brick->size();
+            while (_size > _maxSize)
+            {
+                const Entry& entry = _lru.back();
+                if (!entry.onDisk && !_dir.empty())
+                    evicted.emplace_back(
+                        _getPath(entry.id, entry.brick->size()), entry.brick);
+                _size -= entry.brick->size();
+                _index.erase(entry.id);
+                _lru.pop_back();
+            }
+        }
+
+        size_t written = 0;
+        for (const auto& i : evicted)
+        {
+            if (!i.first.empty() &&
+                cache::write(i.first, {cache::Block(i.second->data(),
+                                                    i.second->size())}))
+            {
+                written += i.second->size();
+            }
+        }
+        if (written == 0)
+            return;
+
+        // trim after writing a fraction of the budget, not for every brick
+        {
+            const std::lock_guard<std::mutex> lock(_mutex);
+            _written += written;
+            if (_written < _maxDiskSize / 16)
+                return;
+            _written = 0;
+        }
+        cache::trim(_dir, _maxDiskSize);
+    }
+};
+}
+
 class DataSource::Impl
 {
 public:
     explicit Impl(const livre::DataSourcePluginData& pluginData)
         : params(pluginData.getURI())
-        , source(params.newImageSource<FloatVolume>())
-        , scaler(source->GetOutput(), params.getInputRange())
+        , loader(params.newEventSource())
+        , _bricks(params, std::to_string(pluginData.getURI()))
+        // the summation image source loads several chunks of events itself
+        , _concurrent(params.getFunctorType() != FunctorType::unknown ||
+                      loader->getNumChunks() == 1)
+        , _maxFramesSize(_concurrent ? params.getFrameCacheSize() : 0)
+        , _numCores(std::max(std::thread::hardware_concurrency(), 1u))
+        , _numPipelines(1)
+        , _timeStep(0)
+        , _loaded(false)
+        , _numSampling(0)
+        , _framesSize(0)
+        , _framesVersion(0)
     {
+        // more pipelines are created on demand, one per brick sampled
+        // concurrently. With backend=auto, this one selects the backend for
+        // all.
+        _pipelines.emplace_back(new Pipeline(params, loader));
+        _pipelines.back()->source->setLoadEvents(!_concurrent);
+        source = _pipelines.front()->source;
+        _bricks.setFrameRange(loader->getFrameRange());
     }
 
     livre::MemoryUnitPtr sample(const livre::LODNode& node,
                                 const livre::VolumeInformation& info) const
     {
-        // called from multiple render threads, only have one update running
-        lunchbox::ScopedWrite mutex(_lock);
-        EventSourcePtr loader = source->getEventSource();
-        const uint32_t timeStep = node.getNodeId().getTimeStep();
-        loader->setTime(timeStep);
-
         const vmml::Vector3i& voxels = info.maximumBlockSize;
+        const size_t size = voxels[0] * voxels[1] * voxels[2] * info.compCount *
+                            info.getBytesPerVoxel();
+
+        // revisited bricks are copied from the brick cache without waiting
+        // for the sampling of other timesteps
+        const uint64_t id = node.getNodeId().getId();
+        if (_bricks.isEnabled())
+        {
+            const BrickPtr brick = _bricks.get(id, size);
+            if (brick)
+                return livre::MemoryUnitPtr(
+                    new livre::AllocMemoryUnit(brick->data(), size));
+        }
+
+        // called from multiple data loading threads, bricks of the same
+        // timestep are sampled concurrently with one pipeline each
+        const Sampling sampling(*this, node.getNodeId().getTimeStep());
+        Pipeline& pipeline = *sampling.pipeline;
 
         ByteVolume::SizeType vSize;
         vSize[0] = voxels[0];
@@ -82,6 +355,10 @@ public:
             info.rootNode.getDepth() - 1 - node.getRefLevel();
         const float spacingFactor = 1 << levelFromBottom;
 
+        // coarse levels sample the events merged per voxel of the level
+        pipeline.source->setEventSource(
+            _lod ? _lod->getLevel(levelFromBottom) : loader);
+
         ByteVolume::SpacingType spacing;
         spacing[0] = baseSpacing.find_max() * spacingFactor;
         spacing[1] = spacing[0];
@@ -96,25 +373,26 @@ public:
         origin[1] = offset[1];
         origin[2] = offset[2];
 
-        auto volume = source->GetOutput();
+        auto volume = pipeline.source->GetOutput();
         volume->SetRegions(region);
         volume->SetSpacing(spacing);
         volume->SetOrigin(origin);
 
-        source->Modified();
-        scaler.Update();
+        pipeline.source->Modified();
+        pipeline.scaler.Update();
 
-        const size_t size = voxels[0] * voxels[1] * voxels[2] * info.compCount *
-                            info.getBytesPerVoxel();
-        return livre::MemoryUnitPtr(
-            new livre::AllocMemoryUnit(scaler.GetOutput()->GetBufferPointer(),
-                                       size));
+        const uint8_t* data = pipeline.scaler.GetOutput()->GetBufferPointer();
+        if (_bricks.isEnabled())
+            // within the sampling, so update() can't drop the cached bricks
+            // in between
+            _bricks.put(id, std::make_shared<Brick>(data, data + size));
+        return livre::MemoryUnitPtr(new livre::AllocMemoryUnit(data, size));
     }
 
     bool update(livre::VolumeInformation& info)
     {
-        EventSourcePtr loader = source->getEventSource();
-        lunchbox::ScopedWrite mutex(_lock);
+        std::unique_lock<std::mutex> lock(_lock);
+        _done.wait(lock, [this] { return _numSampling == 0; });
         const Vector2ui& frameRange = loader->getFrameRange();
 
         if (info.frameRange == frameRange)
@@ -122,16 +400,171 @@ public:
 
         if (frameRange[1] > 0) // is any frame present
             info.frameRange = frameRange;
+        _bricks.setFrameRange(frameRange);
+        // a stream may have more data for the loaded and cached frames
+        _loaded = false;
+        _frames.clear();
+        _framesSize = 0;
         return true;
     }
 
+    BrickCacheStatistics getBrickCacheStatistics() const
+    {
+        return _bricks.getStatistics();
+    }
+
+    /** Merge the events for the coarse levels, if loaded by the data source */
+    void setupLOD(const livre::VolumeInformation& info)
+    {
+        if (!_concurrent || !params.getEventLOD())
+            return;
+
+        const AABBf& bbox = source->getBoundingBox();
+        const Vector3f& baseSpacing = (bbox.getSize() + _borders) / info.voxels;
+        _lod.reset(new EventLOD(params, loader, bbox.getMin() - _borders / 2.0f,
+                                baseSpacing.find_max()));
+    }
+
     const URIHandler params;
-    ImageSourcePtr<FloatVolume> source;
-    mutable ScaleFilter<ByteVolume> scaler;
+    EventSourcePtr loader; // shared by all pipelines
+    ImageSourcePtr<FloatVolume> source; // of the first pipeline, for setup
     Vector3f _borders;
 
 private:
+    /** Scoped sampling of a brick of a timestep with an idle pipeline */
+    struct Sampling
+    {
+        Sampling(const Impl& impl_, const uint32_t timeStep)
+            : impl(impl_)
+            , pipeline(impl.beginSampling(timeStep))
+        {
+        }
+
+        ~Sampling() { impl.endSampling(std::move(pipeline)); }
+        const Impl& impl;
+        PipelinePtr pipeline;
+    };
+
+    /**
+     * Load the given timestep after the bricks of the loaded one are done, and
+     * take an idle pipeline or create one. The cores are shared by the bricks
+     * in flight, so a single brick uses all of them.
+     */
+    PipelinePtr beginSampling(const uint32_t timeStep) const
+    {
+        std::unique_lock<std::mutex> lock(_lock);
+        const size_t maxPipelines = _concurrent ? _numCores : 1;
+        _done.wait(lock, [this, timeStep, maxPipelines] {
+            return (!_pipelines.empty() || _numPipelines < maxPipelines) &&
+                   (_numSampling == 0 || (_loaded && _timeStep == timeStep));
+        });
+
+        if (!_loaded || _timeStep != timeStep)
+        {
+            loader->setTime(timeStep);
+            if (_concurrent)
+                loadFrame(timeStep);
+            if (_lod)
+                _lod->invalidateValues();
+            _timeStep = timeStep;
+            _loaded = true;
+        }
+
+        ++_numSampling;
+        PipelinePtr pipeline;
+        if (_pipelines.empty())
+        {
+            // the output volumes are only allocated on the first update
+            pipeline.reset(new Pipeline(params, loader));
+            pipeline->source->setLoadEvents(false);
+            ++_numPipelines;
+        }
+        else
+        {
+            pipeline = std::move(_pipelines.back());
+            _pipelines.pop_back();
+        }
+        pipeline->setNumberOfThreads(std::max(_numCores / _numSampling,
+                                              size_t(1)));
+        return pipeline;
+    }
+
+    /**
+     * Load the values of the given timestep, or adopt them from the frame
+     * cache if it was loaded before. Scrubbing the timeline revisits the same
+     * frames, which are then not read again.
+     */
+    void loadFrame(const uint32_t timeStep) const
+    {
+        if (_framesVersion != loader->getGeometryVersion())
+        {
+            _frames.clear();
+            _framesSize = 0;
+        }
+
+        const auto i = std::find_if(_frames.begin(), _frames.end(),
+                                    [timeStep](const Frame& frame) {
+                                        return frame.first == timeStep;
+                                    });
+        if (i != _frames.end())
+        {
+            _frames.splice(_frames.begin(), _frames, i);
+            loader->adoptValues(i->second);
+            return;
+        }
+
+        loader->load();
+        if (_framesVersion != loader->getGeometryVersion())
+        {
+            _frames.clear();
+            _framesSize = 0;
+            _framesVersion = loader->getGeometryVersion();
+        }
+
+        const size_t numEvents = loader->getNumEvents();
+        const size_t size = numEvents * sizeof(float);
+        if (size == 0 || size > _maxFramesSize)
+            return;
+
+        const float* values = loader->getValues();
+        _frames.emplace_front(timeStep, std::make_shared<brion::floats>(
+                                            values, values + numEvents));
+        _framesSize += size;
+        while (_framesSize > _maxFramesSize)
+        {
+            _framesSize -= _frames.back().second->size() * sizeof(float);
+            _frames.pop_back();
+        }
+    }
+
+    void endSampling(PipelinePtr pipeline) const
+    {
+        {
+            const std::lock_guard<std::mutex> lock(_lock);
+            _pipelines.push_back(std::move(pipeline));
+            --_numSampling;
+        }
+        _done.notify_all();
+    }
+
+    // timestep and values of a loaded frame
+    typedef std::pair<uint32_t, brion::floatsPtr> Frame;
+
+    mutable BrickCache _bricks;
+    std::unique_ptr<EventLOD> _lod;
+    const bool _concurrent;
+    const size_t _maxFramesSize; // bytes of cached frames, 0 if disabled
+    const size_t _numCores;
     mutable std::mutex _lock;
+    mutable std::condition_variable _done;
+    mutable std::vector<PipelinePtr> _pipelines; // idle pipelines
+    mutable size_t _numPipelines;                // idle and sampling
+    mutable uint32_t _timeStep;                  // loaded timestep
+    mutable bool _loaded;
+    mutable size_t _numSampling; // bricks of _timeStep being sampled
+    mutable std::list<Frame> _frames; // most recently used first
+    mutable size_t _framesSize;       // bytes
+    mutable uint64_t _framesVersion;  // geometry version of the frames
 };
 
 DataSource::DataSource(const livre::DataSourcePluginData& pluginData)
@@ -187,6 +620,7 @@ DataSource::DataSource(const livre::DataSourcePluginData& pluginData)
 
     if (!livre::fillRegularVolumeInfo(_volumeInfo))
         LBTHROW(std::runtime_error("Cannot setup the regular tree"));
+    _impl->setupLOD(_volumeInfo);
 
     const float maxDim =
         std::max(_impl->_borders.x() + bbox.getSize().x(),
@@ -204,6 +638,11 @@ DataSource::~DataSource()
 {
 }
 
+DataSource::BrickCacheStatistics DataSource::getBrickCacheStatistics() const
+{
+    return _impl->getBrickCacheStatistics();
+}
+
 livre::MemoryUnitPtr DataSource::getData(const livre::LODNode& node)
 {
     try
@@ -57,6 +57,24 @@ public:
      */
     bool update() final;
 
+    /** Statistics of the requests served from the brick cache */
+    struct BrickCacheStatistics
+    {
+        BrickCacheStatistics()
+            : hits(0)
+            , diskHits(0)
+            , misses(0)
+        {
+        }
+
+        size_t hits;     //!< bricks found in memory
+        size_t diskHits; //!< bricks read back from the brick cache directory
+        size_t misses;   //!< bricks sampled
+    };
+
+    /** @return the brick cache statistics since the data source was created */
+    BrickCacheStatistics getBrickCacheStatistics() const;
+
 private:
     class Impl;
     std::unique_ptr<Impl> _impl;
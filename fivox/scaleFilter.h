@@ -90,6 +90,15 @@ public:
             _rescale->Update();
     }
 
+    /** Set the number of threads of the scaling, see itk::ProcessObject */
+    FIVOX_API void SetNumberOfThreads(const itk::ThreadIdType numThreads)
+    {
+        if (_scaler)
+            _scaler->SetNumberOfThreads(numThreads);
+        else
+            _rescale->SetNumberOfThreads(numThreads);
+    }
+
 private:
     typename IntensityWindowingImageFilter::Pointer _scaler;
     typename RescaleFilter::Pointer _rescale;
@@ -41,40 +41,99 @@ class SomaLoader::Impl
 public:
     Impl(EventSource& output, const URIHandler& params)
         : _output(output)
-        , _report(params.getConfig().getReportSource(params.getReport()),
-                  brion::MODE_READ, params.getGIDs())
+        , _source(params.getConfig().getReportSource(params.getReport()))
+        , _report(_source, brion::MODE_READ, params.getGIDs())
+        , _mapping(helpers::computeInverseMapping(_report))
+        , _frames(_report)
+        , _isSomaReport(false)
     {
         const brain::Circuit circuit(params.getConfig());
-        const auto morphologies =
-            circuit.loadMorphologies(params.getGIDs(),
-                                     brain::Circuit::Coordinates::global);
-
         // add soma events only
-        helpers::addCompartmentEvents(morphologies, _report, output, true);
+        helpers::addCompartmentEvents(params, circuit, _report, _mapping,
+                                      output, true);
+        if (!params.getGroupBy().empty())
+        {
+            brion::Strings names;
+            const brion::uint16_ts& groups =
+                helpers::computeCellGroups(circuit, _report.getGIDs(),
+                                           params.getGroupBy(), names);
+            helpers::addCompartmentGroups(groups, names, _mapping, output,
+                                          true);
+        }
+        _computeSomaOffsets(_report);
+    }
+
+    void setRegionOfInterest(const AABBf& region)
+    {
+        auto regionReport = helpers::selectCellsInRegion(
+            region, _source, _regionReport ? *_regionReport : _report,
+            _mapping, _output, true);
+        if (!regionReport)
+            return;
+        _frames.setReport(*regionReport);
+        _regionReport = std::move(regionReport);
+        _computeSomaOffsets(*_regionReport);
     }
 
     ssize_t load()
     {
-        const brion::floatsPtr frame =
-            _report.loadFrame(_output.getCurrentTime()).get();
+        if (_output.getNumEvents() == 0)
+            return 0;
+
+        const brion::floatsPtr frame = _frames.load(_output.getCurrentTime());
         if (!frame)
             return -1;
 
-        const brion::GIDSet& gids = _report.getGIDs();
-        const brion::SectionOffsets& offsets = _report.getOffsets();
-        const std::vector<float> reportValues = *frame;
-
-        for (size_t i = 0; i < gids.size(); ++i)
+        // soma reports need no gathering, use the frame as is
+        if (_isSomaReport && frame->size() == _somaOffsets.size())
         {
-            // This code assumes that section 0 is the soma.
-            const float v = reportValues[offsets[i][0]];
-            _output[i] = v;
+            _output.adoptValues(frame);
+            return frame->size();
         }
-        return gids.size();
+
+        const float* reportValues = frame->data();
+        for (size_t i = 0; i < _somaOffsets.size(); ++i)
+            _values[i] = reportValues[_somaOffsets[i]];
+        _output.setValues(0, _values.size(), _values.data());
+        return _values.size();
     }
 
     EventSource& _output;
+    const URI _source;
     brion::CompartmentReport _report;
+    // inverse mapping of the current report, the region report if any
+    helpers::FlatInverseMapping _mapping;
+    // report of the cells in the region of interest, if not all
+    std::unique_ptr<brion::CompartmentReport> _regionReport;
+    helpers::FrameReader<> _frames;
+
+    // frame offset of the soma of each event, in event order
+    std::vector<uint64_t> _somaOffsets;
+    brion::floats _values;
+    bool _isSomaReport;
+
+private:
+    void _computeSomaOffsets(const brion::CompartmentReport& report)
+    {
+        // same order as the events created by addCompartmentEvents(). This
+        // code assumes that section 0 is the soma.
+        _somaOffsets.clear();
+        for (const auto& i : _mapping)
+        {
+            size_t offset;
+            uint32_t cellIndex;
+            uint32_t sectionId;
+            uint16_t compartments;
+            std::tie(offset, cellIndex, sectionId, compartments) = i;
+            if (sectionId == 0)
+                _somaOffsets.insert(_somaOffsets.end(), compartments, offset);
+        }
+        _values.resize(_somaOffsets.size());
+
+        _isSomaReport = report.getFrameSize() == _somaOffsets.size();
+        for (size_t i = 0; _isSomaReport && i < _somaOffsets.size(); ++i)
+            _isSomaReport = _somaOffsets[i] == i;
+    }
 };
 
 SomaLoader::SomaLoader(const URIHandler& params)
@@ -87,6 +146,7 @@ SomaLoader::SomaLoader(const URIHandler& params)
 
 SomaLoader::~SomaLoader()
 {
+    finishPrefetch();
 }
 
 Vector2f SomaLoader::_getTimeRange() const
@@ -94,6 +154,16 @@ Vector2f SomaLoader::_getTimeRange() const
     return Vector2f(_impl->_report.getStartTime(), _impl->_report.getEndTime());
 }
 
+void SomaLoader::_prefetch(const double time)
+{
+    _impl->_frames.prefetch(time);
+}
+
+void SomaLoader::_setRegionOfInterest(const AABBf& region)
+{
+    _impl->setRegionOfInterest(region);
+}
+
 ssize_t SomaLoader::_load(const size_t /*chunkIndex*/,
                           const size_t /*numChunks*/)
 {
@@ -20,12 +20,17 @@
  */
 
 #include "spikeLoader.h"
+#include "gidMapping.h"
+#include "helpers.h"
+#include "spikeStore.h"
 #include "uriHandler.h"
 
 #include <brain/brain.h>
 #include <brion/brion.h>
 
-#include <lunchbox/os.h>
+#include <lunchbox/log.h>
+
+#include <algorithm>
 
 using boost::lexical_cast;
 
@@ -37,27 +42,56 @@ public:
     Impl(EventSource& output, const URIHandler& params)
         : _output(output)
         , _spikesStart(0.f)
+        , _gidMapping(params.getGIDs())
+        , _binBase(0)
+        , _binOffsets(1, 0)
+        , _windowFirst(0)
+        , _windowLast(0)
+        , _windowValid(false)
     {
         const brion::GIDSet& gids = params.getGIDs();
 
         const brain::Circuit circuit(params.getConfig());
         const brion::Vector3fs& positions = circuit.getPositions(gids);
 
-        size_t i = 0;
         _output.resize(gids.size());
+        _output.setPositions(0, positions);
+        _output.setRadii(0, gids.size(), /*radius*/ 0.f);
+        _output.setValues(0, gids.size(), /*value*/ 0.f);
         _spikesPerNeuron.resize(gids.size());
-        _gidIndex.resize(*gids.rbegin() + 1);
-        for (const uint32_t gid : gids)
+        _isActive.resize(gids.size(), false);
+
+        if (!params.getGroupBy().empty())
         {
-            _output.update(i, positions[i], /*radius*/ 0.f);
-            _gidIndex[gid] = i++;
+            brion::Strings names;
+            const brion::uint16_ts& groups =
+                helpers::computeCellGroups(circuit, gids, params.getGroupBy(),
+                                           names);
+            _output.setGroupNames(names);
+            _output.setGroups(0, groups.size(), groups.data());
         }
 
         const std::string& spikePath = params.getSpikes();
-        _report.reset(new brain::SpikeReportReader(
-            spikePath.empty() ? params.getConfig().getSpikeSource()
-                              : URI(spikePath),
-            gids));
+        const URI spikeURI = spikePath.empty()
+                                 ? params.getConfig().getSpikeSource()
+                                 : URI(spikePath);
+        if (SpikeStore::hasCache(spikeURI))
+        {
+            const std::string& cache = SpikeStore::getCachePath(spikeURI);
+            try
+            {
+                _store.reset(new SpikeStore(cache));
+                _spikesEnd = _store->getEndTime();
+                LBINFO << "Using spike store " << cache << std::endl;
+                return;
+            }
+            catch (const std::exception& e)
+            {
+                LBWARN << "Ignoring spike store: " << e.what() << std::endl;
+            }
+        }
+
+        _report.reset(new brain::SpikeReportReader(spikeURI, gids));
         _spikesEnd = _report->getEndTime();
     }
 
@@ -80,45 +114,308 @@ public:
     ssize_t load()
     {
         const float start = _output.getCurrentTime();
-        lunchbox::setZero(_spikesPerNeuron.data(),
-                          _spikesPerNeuron.size() * sizeof(size_t));
-
         const float end = start + _output.getDuration();
-        const size_t numSpikes = _loadSpikes(start, end);
 
-        for (size_t i = 0; i < _spikesPerNeuron.size(); ++i)
-            _output[i] = _spikesPerNeuron[i];
+        size_t first, last;
+        const size_t numSpikes = _getBins(start, end, first, last) &&
+                                         _indexBins(first, last)
+                                     ? _loadBins(first, last)
+                                     : _loadSpikes(start, end);
+
+        // drop the neurons whose spikes all left the window
+        size_t numActive = 0;
+        for (const uint32_t index : _active)
+        {
+            if (_spikesPerNeuron[index] > 0)
+                _active[numActive++] = index;
+            else
+                _isActive[index] = false;
+        }
+        _active.resize(numActive);
+        std::sort(_active.begin(), _active.end());
+
+        _values.resize(numActive);
+        for (size_t i = 0; i < numActive; ++i)
+            _values[i] = _spikesPerNeuron[_active[i]];
+        _output.setSparseValues(_active, _values.data());
 
         return numSpikes;
     }
 
     size_t _loadSpikes(const float start, const float end)
     {
+        _clearWindow();
         size_t numSpikes = 0;
+        _forEachSpike(start, end, [&](const float, const size_t index) {
+            _addSpike(index);
+            ++numSpikes;
+        });
+
+        return numSpikes;
+    }
+
+    /**
+     * Call func(time, index) for each spike of the target in the time window
+     * [start, end), with index being the index of the neuron in the target.
+     */
+    template <typename F>
+    void _forEachSpike(const float start, const float end, const F& func)
+    {
+        if (_store)
+        {
+            // the store contains the spikes of all neurons
+            const SpikeStore::SpikeRange& spikes =
+                _store->getSpikes(start, end);
+            for (const brion::Spike* i = spikes.first; i != spikes.second; ++i)
+            {
+                const size_t index = _gidMapping.find(i->second);
+                if (index != GIDMapping::invalid())
+                    func(i->first, index);
+            }
+            return;
+        }
+
         for (const auto& spike : _report->getSpikes(start, end))
+            func(spike.first, _gidMapping.find(spike.second));
+    }
+
+    /** @return the start time of the given dt bin, as computed by setFrame() */
+    float _getBinStart(const size_t bin) const
+    {
+        return _spikesStart + _output.getDt() * bin;
+    }
+
+    /** @return the dt bin of the given time */
+    size_t _getBin(const float time) const
+    {
+        const double bin = std::floor((time - _spikesStart) / _output.getDt());
+        size_t result = bin > 0. ? size_t(bin) : 0;
+
+        // match the float rounding of the bin boundaries
+        while (result > 0 && time < _getBinStart(result))
+            --result;
+        while (time >= _getBinStart(result + 1))
+            ++result;
+        return result;
+    }
+
+    /**
+     * Get the range of dt bins [first, last) covering the time window
+     * [start, end).
+     * @return false if the window is not aligned to the dt bins.
+     */
+    bool _getBins(const float start, const float end, size_t& first,
+                  size_t& last) const
+    {
+        const double dt = _output.getDt();
+        if (dt <= 0. || start < _spikesStart)
+            return false;
+
+        first = std::round((start - _spikesStart) / dt);
+        last = std::round((end - _spikesStart) / dt);
+
+        const float epsilon = dt * 0.001;
+        return first < last &&
+               std::abs(_getBinStart(first) - start) <= epsilon &&
+               std::abs(_getBinStart(last) - end) <= epsilon;
+    }
+
+    /**
+     * Index the spikes of the bins [first, last). The index is extended if it
+     * reaches the first bin, and restarted at the first bin otherwise, so the
+     * cost scales with the requested windows and not with their start time.
+     * @return false if the bins are not complete yet in a stream.
+     */
+    bool _indexBins(const size_t first, const size_t last)
+    {
+        size_t indexEnd = _binBase + _binOffsets.size() - 1;
+        if (first >= _binBase && last <= indexEnd)
+            return true;
+
+        if (_report && !_report->hasEnded() &&
+            _getBin(_report->getEndTime()) < last)
         {
-            ++_spikesPerNeuron[_gidIndex[spike.second]];
-            ++numSpikes;
+            return false;
         }
 
+        if (first < _binBase || first > indexEnd)
+        {
+            _clearWindow(); // its bins are dropped from the index
+            _binBase = first;
+            _binOffsets.assign(1, 0);
+            _binSpikes.clear();
+            indexEnd = first;
+        }
+        else
+            _dropBins(_windowValid ? std::min(first, _windowFirst) : first);
+
+        // counting sort of the new spikes by bin, appended to the CSR index
+        const size_t numBins = last - indexEnd;
+        brion::size_ts bins;
+        std::vector<uint32_t> indices;
+        brion::size_ts counts(numBins, 0);
+        _forEachSpike(_getBinStart(indexEnd), _getBinStart(last),
+                      [&](const float time, const size_t index) {
+                          const size_t bin =
+                              std::min(std::max(_getBin(time), indexEnd),
+                                       last - 1) -
+                              indexEnd;
+                          bins.push_back(bin);
+                          indices.push_back(index);
+                          ++counts[bin];
+                      });
+
+        const size_t numSpikes = _binSpikes.size();
+        const size_t numIndexed = _binOffsets.size() - 1;
+        _binOffsets.reserve(numIndexed + numBins + 1);
+        for (size_t i = 0; i < numBins; ++i)
+            _binOffsets.push_back(_binOffsets.back() + counts[i]);
+
+        _binSpikes.resize(numSpikes + indices.size());
+        for (size_t i = 0; i < numBins; ++i)
+            counts[i] = _binOffsets[numIndexed + i];
+        for (size_t i = 0; i < indices.size(); ++i)
+            _binSpikes[counts[bins[i]]++] = indices[i];
+        return true;
+    }
+
+    /**
+     * Drop the bins before the given one from the spike index once they hold
+     * most of its spikes, amortizing the move of the remaining ones.
+     */
+    void _dropBins(const size_t bin)
+    {
+        if (bin <= _binBase)
+            return;
+        const size_t numDropped = _getOffset(bin);
+        if (2 * numDropped < _binSpikes.size())
+            return;
+
+        _binSpikes.erase(_binSpikes.begin(), _binSpikes.begin() + numDropped);
+        _binOffsets.erase(_binOffsets.begin(),
+                          _binOffsets.begin() + (bin - _binBase));
+        for (size_t& offset : _binOffsets)
+            offset -= numDropped;
+        _binBase = bin;
+    }
+
+    /** @return the offset in _binSpikes of the first spike of an indexed bin */
+    size_t _getOffset(const size_t bin) const
+    {
+        return _binOffsets[bin - _binBase];
+    }
+
+    /** Count the spikes of the window [first, last) from the spike index. */
+    size_t _loadBins(const size_t first, const size_t last)
+    {
+        const size_t numSpikes = _getOffset(last) - _getOffset(first);
+
+        // slide the current window if it costs less than a full recount
+        const bool overlaps =
+            _windowValid && first < _windowLast && _windowFirst < last;
+        const size_t slideCost = overlaps ? _countSpikes(_windowFirst, first) +
+                                                _countSpikes(first, _windowFirst) +
+                                                _countSpikes(last, _windowLast) +
+                                                _countSpikes(_windowLast, last)
+                                          : 0;
+        if (overlaps && slideCost < numSpikes + _active.size())
+        {
+            // subtract the leaving bins, add the entering bins
+            _countBins(_windowFirst, first, false);
+            _countBins(last, _windowLast, false);
+            _countBins(first, _windowFirst, true);
+            _countBins(_windowLast, last, true);
+        }
+        else
+        {
+            _clearWindow();
+            _countBins(first, last, true);
+        }
+
+        _windowFirst = first;
+        _windowLast = last;
+        _windowValid = true;
         return numSpikes;
     }
 
+    /** @return the number of spikes in the bins [first, last), 0 if empty */
+    size_t _countSpikes(const size_t first, const size_t last) const
+    {
+        return first < last ? _getOffset(last) - _getOffset(first) : 0;
+    }
+
+    void _countBins(const size_t first, const size_t last, const bool add)
+    {
+        if (first >= last)
+            return;
+
+        const size_t begin = _getOffset(first);
+        const size_t end = _getOffset(last);
+        if (add)
+        {
+            for (size_t i = begin; i < end; ++i)
+                _addSpike(_binSpikes[i]);
+        }
+        else
+        {
+            for (size_t i = begin; i < end; ++i)
+                --_spikesPerNeuron[_binSpikes[i]];
+        }
+    }
+
+    void _addSpike(const size_t index)
+    {
+        ++_spikesPerNeuron[index];
+        if (!_isActive[index])
+        {
+            _isActive[index] = true;
+            _active.push_back(index);
+        }
+    }
+
+    void _clearWindow()
+    {
+        for (const uint32_t index : _active)
+        {
+            _spikesPerNeuron[index] = 0;
+            _isActive[index] = false;
+        }
+        _active.clear();
+        _windowValid = false;
+    }
+
     EventSource& _output;
     float _spikesStart;
     float _spikesEnd;
 
     // maps GID to its index in the target
-    // OPT: no (unordered)map because of constant lookup but 'wastes' memory
-    // (container.size() is number of GIDs)
-    brion::size_ts _gidIndex;
+    const GIDMapping _gidMapping;
 
     // aggregates spikes for each neuron in interval
     // OPT: no (unordered)map because of constant lookup but 'wastes' memory
     // (container.size() is number of GIDs)
     brion::size_ts _spikesPerNeuron;
+    brion::floats _values; // of the _active neurons
+
+    // neurons with spikes in the window, and maybe some whose spikes left it;
+    // all others have no spikes in _spikesPerNeuron
+    brion::uint32_ts _active;
+    std::vector<bool> _isActive;
+
+    // CSR index of the spikes per dt bin from _binBase: the target indices of
+    // the spikes of bin _binBase + i are
+    // _binSpikes[_binOffsets[i], _binOffsets[i+1])
+    size_t _binBase;
+    brion::size_ts _binOffsets;
+    std::vector<uint32_t> _binSpikes;
+
+    // bins [first, last) counted in _spikesPerNeuron, if valid
+    size_t _windowFirst;
+    size_t _windowLast;
+    bool _windowValid;
 
     std::unique_ptr<brain::SpikeReportReader> _report;
+    std::unique_ptr<SpikeStore> _store; // used instead of _report if present
 };
 
 SpikeLoader::SpikeLoader(const URIHandler& params)
@@ -131,6 +428,7 @@ SpikeLoader::SpikeLoader(const URIHandler& params)
 
 SpikeLoader::~SpikeLoader()
 {
+    finishPrefetch();
 }
 
 Vector2f SpikeLoader::_getTimeRange() const
@@ -0,0 +1,235 @@
+/* Copyright (c) 2017, EPFL/Blue Brain Project
+ *
+ * This file is part of Fivox <https://github.com/BlueBrain/Fivox>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "spikeStore.h"
+
+#include <brain/spikeReportReader.h>
+
+#include <lunchbox/debug.h>
+#include <lunchbox/log.h>
+#include <lunchbox/memoryMap.h>
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+
+namespace
+{
+const uint32_t magic = 0x5b1e;
+const uint32_t version = 1;
+const uint32_t spikesPerBlock = 4096;
+const float readWindow = 1000.f; // ms of spikes read at once in convert()
+const std::string cacheSuffix(".fivoxspikes");
+
+/**
+ * File layout: Header, numSpikes brion::Spike, numBlocks float with the time
+ * of the first spike of each block.
+ */
+struct Header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t numSpikes;
+    uint64_t numBlocks;
+    uint32_t spikesPerBlock;
+    float startTime;
+    float endTime;
+    uint32_t padding;
+};
+
+static_assert(sizeof(brion::Spike) == 2 * sizeof(uint32_t),
+              "brion::Spike must be a packed (float, uint32_t) pair");
+
+bool _getModificationTime(const std::string& filename, time_t& time)
+{
+    struct stat info;
+    if (::stat(filename.c_str(), &info) != 0)
+        return false;
+    time = info.st_mtime;
+    return true;
+}
+}
+
+namespace fivox
+{
+class SpikeStore::Impl
+{
+public:
+    explicit Impl(const std::string& filename)
+        : file(filename)
+    {
+        const size_t size = file.getSize();
+        header = file.getAddress<Header>();
+        if (!header || size < sizeof(Header) || header->magic != magic)
+            LBTHROW(std::runtime_error(filename + " is not a spike store"));
+        if (header->version != version)
+            LBTHROW(std::runtime_error("Incompatible spike store version in " +
+                                       filename));
+
+        spikes = reinterpret_cast<const brion::Spike*>(header + 1);
+        blockTimes = reinterpret_cast<const float*>(spikes + header->numSpikes);
+        if (sizeof(Header) + header->numSpikes * sizeof(brion::Spike) +
+                header->numBlocks * sizeof(float) >
+            size)
+        {
+            LBTHROW(std::runtime_error("Truncated spike store " + filename));
+        }
+    }
+
+    /** @return the first spike at or after the given time */
+    const brion::Spike* find(const float time) const
+    {
+        // the first spike not before time is in the block preceding the first
+        // block starting at or after time, or the first spike of that block
+        const size_t numBlocks = header->numBlocks;
+        const size_t block =
+            std::lower_bound(blockTimes, blockTimes + numBlocks, time) -
+            blockTimes;
+        const size_t perBlock = header->spikesPerBlock;
+        const brion::Spike* first =
+            spikes + (block > 0 ? block - 1 : 0) * perBlock;
+        const brion::Spike* last =
+            spikes + std::min<size_t>(block * perBlock, header->numSpikes);
+
+        return std::lower_bound(first, last, time,
+                                [](const brion::Spike& spike, const float t) {
+                                    return spike.first < t;
+                                });
+    }
+
+    lunchbox::MemoryMap file;
+    const Header* header;
+    const brion::Spike* spikes;
+    const float* blockTimes;
+};
+
+SpikeStore::SpikeStore(const std::string& filename)
+    : _impl(new Impl(filename))
+{
+}
+
+SpikeStore::~SpikeStore()
+{
+}
+
+void SpikeStore::convert(const URI& report, const std::string& filename)
+{
+    brain::SpikeReportReader reader(report);
+    const float endTime = reader.getEndTime();
+
+    // the report starts with its first spike, which may be before t=0
+    float startTime = 0.f;
+    for (const brion::Spike& spike :
+         reader.getSpikes(-std::numeric_limits<float>::max(), 0.f))
+    {
+        startTime = std::min(startTime, spike.first);
+    }
+
+    const std::string tmpFile = filename + ".tmp";
+    std::ofstream file(tmpFile, std::ios::binary);
+    if (!file.is_open())
+        LBTHROW(std::runtime_error("Cannot open " + tmpFile));
+
+    Header header = {magic, version, 0, 0, spikesPerBlock, 0.f, endTime, 0};
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    brion::floats blockTimes;
+    for (size_t i = 0;; ++i)
+    {
+        const float start = startTime + i * readWindow;
+        const bool last = start + readWindow > endTime;
+        const float end =
+            last ? std::nextafter(endTime, std::numeric_limits<float>::max())
+                 : start + readWindow;
+
+        brion::Spikes spikes = reader.getSpikes(start, end);
+        std::sort(spikes.begin(), spikes.end());
+        for (const brion::Spike& spike : spikes)
+        {
+            if (header.numSpikes == 0)
+                header.startTime = spike.first;
+            if (header.numSpikes % spikesPerBlock == 0)
+                blockTimes.push_back(spike.first);
+            ++header.numSpikes;
+        }
+        file.write(reinterpret_cast<const char*>(spikes.data()),
+                   spikes.size() * sizeof(brion::Spike));
+        if (last)
+            break;
+    }
+
+    header.numBlocks = blockTimes.size();
+    file.write(reinterpret_cast<const char*>(blockTimes.data()),
+               blockTimes.size() * sizeof(float));
+    file.seekp(0);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.close();
+
+    if (!file.good() || std::rename(tmpFile.c_str(), filename.c_str()) != 0)
+    {
+        std::remove(tmpFile.c_str());
+        LBTHROW(std::runtime_error("Error while writing spike store " +
+                                   filename));
+    }
+    LBINFO << "Wrote " << header.numSpikes << " spikes to " << filename
+           << std::endl;
+}
+
+std::string SpikeStore::getCachePath(const URI& report)
+{
+    const std::string& scheme = report.getScheme();
+    if ((!scheme.empty() && scheme != "file") || report.getPath().empty())
+        return std::string();
+    return report.getPath() + cacheSuffix;
+}
+
+bool SpikeStore::hasCache(const URI& report)
+{
+    const std::string& cache = getCachePath(report);
+    time_t reportTime, cacheTime;
+    return !cache.empty() && _getModificationTime(cache, cacheTime) &&
+           _getModificationTime(report.getPath(), reportTime) &&
+           cacheTime >= reportTime;
+}
+
+size_t SpikeStore::getNumSpikes() const
+{
+    return _impl->header->numSpikes;
+}
+
+float SpikeStore::getStartTime() const
+{
+    return _impl->header->startTime;
+}
+
+float SpikeStore::getEndTime() const
+{
+    return _impl->header->endTime;
+}
+
+SpikeStore::SpikeRange SpikeStore::getSpikes(const float start,
+                                             const float end) const
+{
+    const brion::Spike* first = _impl->find(start);
+    const brion::Spike* last = _impl->find(end);
+    return std::make_pair(first, std::max(first, last));
+}
+}
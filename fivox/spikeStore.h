@@ -0,0 +1,104 @@
+/* Copyright (c) 2017, EPFL/Blue Brain Project
+ *
+ * This file is part of Fivox <https://github.com/BlueBrain/Fivox>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef FIVOX_SPIKESTORE_H
+#define FIVOX_SPIKESTORE_H
+
+#include <fivox/api.h>
+#include <fivox/types.h>
+
+namespace fivox
+{
+/**
+ * Memory-mapped binary store of the spikes of a spike report.
+ *
+ * The store contains the time-sorted (time, GID) pairs of all spikes and the
+ * time of the first spike of each fixed-size block of spikes, so the spikes of
+ * a time window are found without parsing or reading the whole report.
+ *
+ * A store written next to a spike report file (see getCachePath()) is used
+ * by the SpikeLoader instead of the report as long as it is newer than the
+ * report.
+ */
+class SpikeStore
+{
+public:
+    /** A range [first, second) of spikes in the store */
+    typedef std::pair<const brion::Spike*, const brion::Spike*> SpikeRange;
+
+    /**
+     * Open a spike store.
+     *
+     * @param filename path of the store file.
+     * @throw std::runtime_error if the file is not a valid spike store.
+     */
+    FIVOX_API explicit SpikeStore(const std::string& filename);
+    FIVOX_API ~SpikeStore();
+
+    /**
+     * Convert a spike report into a spike store.
+     *
+     * The report is read in time windows, so the conversion does not need
+     * memory for all spikes in addition to the report reader. The store is
+     * written to a temporary file first, which is renamed when complete.
+     *
+     * @param report the URI of the spike report.
+     * @param filename path of the store file to write.
+     * @throw std::runtime_error if the report can't be read or the store
+     *        can't be written.
+     */
+    FIVOX_API static void convert(const URI& report,
+                                  const std::string& filename);
+
+    /**
+     * @return the path of the store cache of the given spike report file, or
+     *         an empty string if the report is not a file, e.g. a stream.
+     */
+    FIVOX_API static std::string getCachePath(const URI& report);
+
+    /**
+     * @return true if the store cache of the given spike report exists and is
+     *         not older than the report.
+     */
+    FIVOX_API static bool hasCache(const URI& report);
+
+    /** @return the number of spikes in the store. */
+    FIVOX_API size_t getNumSpikes() const;
+
+    /** @return the time of the first spike in ms. */
+    FIVOX_API float getStartTime() const;
+
+    /** @return the end time of the report in ms. */
+    FIVOX_API float getEndTime() const;
+
+    /**
+     * @return the spikes in the time window [start, end), pointing into the
+     *         mapped store.
+     */
+    FIVOX_API SpikeRange getSpikes(float start, float end) const;
+
+private:
+    SpikeStore(const SpikeStore&) = delete;
+    SpikeStore& operator=(const SpikeStore&) = delete;
+
+    class Impl;
+    std::unique_ptr<Impl> _impl;
+};
+}
+
+#endif
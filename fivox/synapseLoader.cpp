@@ -18,73 +18,687 @@
  */
 
 #include "synapseLoader.h"
+#include "cache.h"
+#include "gidMapping.h"
 #include "uriHandler.h"
 
 #include <brain/brain.h>
 
+#include <lunchbox/clock.h>
+#include <lunchbox/log.h>
+#include <lunchbox/memoryMap.h>
+
+#include <unistd.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <fstream>
 #include <future>
+#include <mutex>
 
 namespace fivox
 {
+namespace
+{
+/** Synapses of numChunks cells, read by one reader thread */
+struct Batch
+{
+    Batch()
+        : firstCell(0)
+        , numChunks(0)
+        , offset(0)
+    {
+    }
+
+    std::shared_ptr<const brain::Synapses> synapses;
+    size_t firstCell; // index of the first cell in the cells of the reader
+    size_t numChunks; // number of cells
+    size_t offset;    // first synapse not loaded yet
+    std::exception_ptr error;
+};
+
+/** Bounded queue of the batches of one reader, closed to stop the reader */
+class BatchQueue
+{
+public:
+    explicit BatchQueue(const size_t maxSize)
+        : _maxSize(maxSize)
+        , _closed(false)
+    {
+    }
+
+    /** @return false if the queue was closed instead of queueing the batch */
+    bool push(const Batch& batch)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _condition.wait(lock, [this] {
+            return _closed || _batches.size() < _maxSize;
+        });
+        if (_closed)
+            return false;
+        _batches.push_back(batch);
+        _condition.notify_all();
+        return true;
+    }
+
+    Batch pop()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _condition.wait(lock, [this] { return _closed || !_batches.empty(); });
+        if (_batches.empty())
+            LBTHROW(std::runtime_error("Synapse reader was stopped"));
+        const Batch batch = _batches.front();
+        _batches.pop_front();
+        _condition.notify_all();
+        return batch;
+    }
+
+    /** Discard the queued batches and unblock the reader */
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _closed = true;
+        _batches.clear();
+        _condition.notify_all();
+    }
+
+    size_t getSize() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _batches.size();
+    }
+
+    size_t getMaxSize() const { return _maxSize; }
+
+private:
+    const size_t _maxSize;
+    mutable std::mutex _mutex;
+    std::condition_variable _condition;
+    std::deque<Batch> _batches;
+    bool _closed;
+};
+
+const uint32_t cacheMagic = 0x5e1a;
+const uint32_t cacheVersion = 3;
+const uint16_t noGroup = 0xffff;
+
+/**
+ * Layout of a synapse cache file: Header, the uint64_t end of the synapses of
+ * each of the numChunks cells, then the X, Y and Z coordinates of the
+ * presynaptic surface positions of numSynapses synapses as float arrays,
+ * followed by their uint16_t groups if numGroups is not 0.
+ */
+struct CacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t numChunks;
+    uint64_t numSynapses;
+    float bbox[6];
+    uint32_t numGroups;
+    uint32_t padding;
+};
+
+/** Writes the positions of a complete pass over the synapses to the cache */
+class CacheWriter
+{
+public:
+    explicit CacheWriter(const std::string& path)
+        : _path(path)
+        , _tmpPath(path + "." + std::to_string(::getpid()))
+        , _numSynapses(0)
+    {
+        for (size_t i = 0; i < numFiles; ++i)
+            _files[i].open(_getTmpPath(i), std::ios::binary);
+    }
+
+    ~CacheWriter()
+    {
+        for (size_t i = 0; i < numFiles; ++i)
+        {
+            _files[i].close();
+            std::remove(_getTmpPath(i).c_str());
+        }
+    }
+
+    /**
+     * Append the positions of the synapses [begin, end) of the given cells and
+     * their groups, if any
+     */
+    void append(const brain::Synapses& synapses, const size_t begin,
+                const size_t end, const uint32_t* cells, const size_t numCells,
+                const uint16_t* groups)
+    {
+        // end of the synapses of each cell, the synapses are ordered by cell
+        const uint32_t* postGIDs = synapses.postGIDs();
+        size_t cellEnd = begin;
+        for (size_t i = 0; i < numCells; ++i)
+        {
+            cellEnd = i + 1 < numCells
+                          ? std::lower_bound(postGIDs + cellEnd,
+                                             postGIDs + end, cells[i + 1]) -
+                                postGIDs
+                          : end;
+            const uint64_t offset = _numSynapses + cellEnd - begin;
+            _files[0].write(reinterpret_cast<const char*>(&offset),
+                            sizeof(offset));
+        }
+
+        const size_t size = end - begin;
+        const float* positions[] = {synapses.preSurfaceXPositions(),
+                                    synapses.preSurfaceYPositions(),
+                                    synapses.preSurfaceZPositions()};
+        for (size_t i = 0; i < 3; ++i)
+            _files[i + 1].write(reinterpret_cast<const char*>(positions[i] +
+                                                              begin),
+                                size * sizeof(float));
+        if (groups)
+            _files[4].write(reinterpret_cast<const char*>(groups),
+                            size * sizeof(uint16_t));
+        _numSynapses += size;
+    }
+
+    /** Assemble the cache file from the data written so far */
+    bool commit(const size_t numChunks, const AABBf& bbox,
+                const size_t numGroups)
+    {
+        const CacheHeader header = {cacheMagic,
+                                    cacheVersion,
+                                    numChunks,
+                                    _numSynapses,
+                                    {bbox.getMin()[0], bbox.getMin()[1],
+                                     bbox.getMin()[2], bbox.getMax()[0],
+                                     bbox.getMax()[1], bbox.getMax()[2]},
+                                    uint32_t(numGroups),
+                                    0};
+
+        std::ofstream file(_tmpPath, std::ios::binary);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        bool good = true;
+        for (size_t i = 0; i < numFiles && good && file.good(); ++i)
+        {
+            _files[i].close();
+            good = _files[i].good();
+            if (good)
+            {
+                std::ifstream data(_getTmpPath(i), std::ios::binary);
+                if (data.peek() != std::ifstream::traits_type::eof())
+                    file << data.rdbuf();
+            }
+        }
+        file.close();
+
+        const bool written = good && file.good() &&
+                             std::rename(_tmpPath.c_str(), _path.c_str()) == 0;
+        if (!written)
+        {
+            std::remove(_tmpPath.c_str());
+            LBWARN << "Could not write synapse cache " << _path << std::endl;
+        }
+        return written;
+    }
+
+private:
+    static const size_t numFiles = 5; // cell offsets, x, y, z, groups
+
+    std::string _getTmpPath(const size_t i) const
+    {
+        return _tmpPath + "." + std::to_string(i);
+    }
+
+    const std::string _path;
+    const std::string _tmpPath;
+    std::ofstream _files[numFiles];
+    uint64_t _numSynapses;
+};
+
+/** Split the GIDs into n contiguous parts of similar size */
+std::vector<brain::GIDSet> _partition(const brain::GIDSet& gids, size_t n)
+{
+    n = std::max(size_t(1), std::min(n, gids.size()));
+    std::vector<brain::GIDSet> partitions(n);
+    size_t i = 0;
+    for (const uint32_t gid : gids)
+        partitions[i++ * n / gids.size()].insert(gid);
+    return partitions;
+}
+}
+
 class SynapseLoader::Impl
 {
 public:
     Impl(EventSource& output, const URIHandler& params)
         : _output(output)
-        , _circuit(params.getConfig())
         , _preGIDs(params.getPreGIDs())
-        , _postGIDs(params.getGIDs())
-        , _synapses(_loadSynapseStream())
-        , _numChunks(_synapses.getRemaining())
+        , _preMapping(_preGIDs)
+        , _readSize(params.getReadSize())
+        , _readAhead(params.getReadAhead())
+        , _numChunks(0)
+        , _next(0)
+        , _reader(0)
+        , _readerWaitTime(0)
+        , _loaderWaitTime(0.)
+        , _maxQueueDepth(0)
     {
-        if (!params.getReferenceVolume().empty())
+        const bool useBoundingBox = params.getReferenceVolume().empty();
+        _setupGroups(params);
+
+        // chunk i is the i-th postsynaptic cell, read by the reader of its
+        // part of the cells
+        _firstChunks.push_back(0);
+        for (const auto& gids :
+             _partition(params.getGIDs(), params.getNumReaders()))
+        {
+            _cells.emplace_back(gids.begin(), gids.end());
+            _firstChunks.push_back(_firstChunks.back() + gids.size());
+        }
+
+        const brion::BlueConfig& config = params.getConfig();
+        cache::Key key;
+        key << std::string("synapses") << params.getConfigPath() << _preGIDs
+            << params.getGIDs() << uint64_t(_output.getNumGroups());
+        key.addFile(params.getConfigPath())
+            .addFile(config.getCircuitSource().getPath())
+            .addFile(config.getSynapseSource().getPath());
+        if (_output.getNumGroups() > 0)
+        {
+            for (const auto& gids : params.getPreTargetGIDs())
+                key << gids;
+        }
+        _cachePath = cache::getPath(params, "synapses", key);
+        if (_openCache())
+        {
+            if (useBoundingBox)
+                _output.setBoundingBox(_cacheBoundingBox);
             return;
+        }
+
+        _circuit.reset(new brain::Circuit(params.getConfig()));
+        _numChunks = _firstChunks.back();
 
         // compute circuit bounding box as we don't have any synapses at this
-        // point
-        const auto& gids = _circuit.getGIDs();
-        const brion::Vector3fs& positions = _circuit.getPositions(gids);
+        // point. Also needed for a cache written with a reference volume.
+        const auto& gids = _circuit->getGIDs();
+        const brion::Vector3fs& positions = _circuit->getPositions(gids);
 
-        AABBf bbox;
         for (const auto& position : positions)
-            bbox.merge(position);
-        _output.setBoundingBox(bbox);
+            _cacheBoundingBox.merge(position);
+        if (useBoundingBox)
+            _output.setBoundingBox(_cacheBoundingBox);
+    }
+
+    /** Label synapses with the index of their presynaptic target */
+    void _setupGroups(const URIHandler& params)
+    {
+        const std::string& groupBy = params.getGroupBy();
+        if (groupBy.empty())
+            return;
+        if (groupBy != "preTarget")
+            LBTHROW(std::runtime_error("Unsupported groupBy '" + groupBy +
+                                       "' for synapses"));
+        if (params.getPreTargets().empty())
+            LBTHROW(std::runtime_error("groupBy=preTarget needs a preTarget"));
+
+        // each synapse is one event of one group, so a cell can't be in
+        // several groups
+        const auto& targets = params.getPreTargetGIDs();
+        _preGroups.resize(_preGIDs.size(), noGroup);
+        for (size_t i = 0; i < targets.size(); ++i)
+        {
+            for (const uint32_t gid : targets[i])
+            {
+                uint16_t& group = _preGroups[_preMapping.find(gid)];
+                if (group != noGroup && group != i)
+                    LBTHROW(std::runtime_error(
+                        "groupBy=preTarget needs disjoint preTargets, cell " +
+                        std::to_string(gid) + " is in " +
+                        params.getPreTargets()[group] + " and " +
+                        params.getPreTargets()[i]));
+                group = uint16_t(i);
+            }
+        }
+        _output.setGroupNames(params.getPreTargets());
+    }
+
+    /**
+     * @return the groups of the synapses [begin, end), empty if not grouped
+     */
+    const brion::uint16_ts& _computeGroups(const brain::Synapses& synapses,
+                                           const size_t begin,
+                                           const size_t end)
+    {
+        _groups.clear();
+        if (_preGroups.empty())
+            return _groups;
+
+        const uint32_t* preGIDs = synapses.preGIDs();
+        _groups.reserve(end - begin);
+        for (size_t i = begin; i < end; ++i)
+            _groups.push_back(_preGroups[_preMapping.find(preGIDs[i])]);
+        return _groups;
+    }
+
+    /** Map the positions from the cache file, if it exists and is valid */
+    bool _openCache()
+    {
+        if (!cache::exists(_cachePath))
+            return false;
+
+        std::unique_ptr<lunchbox::MemoryMap> file(
+            new lunchbox::MemoryMap(_cachePath));
+        const CacheHeader* header = file->getAddress<CacheHeader>();
+        const size_t size = file->getSize();
+        if (!header || size < sizeof(CacheHeader) ||
+            header->magic != cacheMagic || header->version != cacheVersion ||
+            header->numGroups != _output.getNumGroups() ||
+            size < sizeof(CacheHeader) +
+                       header->numChunks * sizeof(uint64_t) +
+                       3 * header->numSynapses * sizeof(float) +
+                       (header->numGroups ? header->numSynapses : 0) *
+                           sizeof(uint16_t))
+        {
+            LBWARN << "Ignoring invalid synapse cache " << _cachePath
+                   << std::endl;
+            return false;
+        }
+
+        _cacheFile = std::move(file);
+        _cacheHeader = header;
+        _numChunks = header->numChunks;
+        _cacheBoundingBox = AABBf(Vector3f(header->bbox[0], header->bbox[1],
+                                           header->bbox[2]),
+                                  Vector3f(header->bbox[3], header->bbox[4],
+                                           header->bbox[5]));
+        LBINFO << "Using synapse cache " << _cachePath << std::endl;
+        return true;
     }
 
-    brain::SynapsesStream _loadSynapseStream()
+    /** Load the synapses of the given chunks from the mapped cache */
+    ssize_t _loadFromCache(const size_t chunkIndex, const size_t numChunks)
+    {
+        const size_t total = _cacheHeader->numSynapses;
+        const uint64_t* ends =
+            reinterpret_cast<const uint64_t*>(_cacheHeader + 1);
+        const size_t first = chunkIndex == 0 ? 0 : ends[chunkIndex - 1];
+        const size_t size = ends[chunkIndex + numChunks - 1] - first;
+        const float* x = reinterpret_cast<const float*>(ends + _numChunks);
+
+        _output.resize(size);
+        _output.setPositions(0, size, x + first, x + total + first,
+                             x + 2 * total + first);
+        if (_output.getNumGroups() > 0)
+        {
+            const uint16_t* groups =
+                reinterpret_cast<const uint16_t*>(x + 3 * total);
+            _output.setGroups(0, size, groups + first);
+        }
+        _output.setRadii(0, size, /*radius*/ 0.f);
+        _output.setValues(0, size, /*value*/ 1.f);
+        return size;
+    }
+
+    ~Impl() { _stopReaders(); }
+
+    brain::SynapsesStream _loadSynapseStream(const brain::GIDSet& postGIDs)
     {
         if (_preGIDs.empty())
-            return _circuit.getAfferentSynapses(
-                _postGIDs, brain::SynapsePrefetch::positions);
+            return _circuit->getAfferentSynapses(
+                postGIDs, brain::SynapsePrefetch::positions);
 
-        return _circuit.getProjectedSynapses(_preGIDs, _postGIDs,
+        return _circuit->getProjectedSynapses(_preGIDs, postGIDs,
                                              brain::SynapsePrefetch::positions);
     }
 
-    ssize_t load(const size_t /*chunkIndex*/, const size_t numChunks)
+    ssize_t load(const size_t chunkIndex, const size_t numChunks)
+    {
+        if (_cacheFile)
+            return _loadFromCache(chunkIndex, numChunks);
+
+        // the readers continue the previous load, restart them elsewhere,
+        // e.g. after a discarded prefetch
+        if (_readers.empty() || chunkIndex != _next)
+            _startReaders(chunkIndex);
+
+        // synapses [begin, end) of the batches of the requested cells
+        struct Range
+        {
+            std::shared_ptr<const brain::Synapses> synapses;
+            size_t begin;
+            size_t end;
+            const uint32_t* cells;
+            size_t numCells;
+        };
+        std::vector<Range> ranges;
+        size_t size = 0;
+        for (size_t needed = numChunks; needed > 0;)
+        {
+            if (!_batch.synapses)
+                _popBatch();
+
+            // split the batch after the requested cells, the synapses of a
+            // batch are ordered by postsynaptic cell
+            const size_t count = std::min(needed, _batch.numChunks);
+            const brain::Synapses& synapses = *_batch.synapses;
+            size_t end = synapses.size();
+            if (count < _batch.numChunks)
+            {
+                const uint32_t* postGIDs = synapses.postGIDs();
+                const uint32_t nextGID =
+                    _cells[_reader][_batch.firstCell + count];
+                end = std::lower_bound(postGIDs + _batch.offset,
+                                       postGIDs + synapses.size(), nextGID) -
+                      postGIDs;
+            }
+
+            ranges.push_back({_batch.synapses, _batch.offset, end,
+                              &_cells[_reader][_batch.firstCell], count});
+            size += end - _batch.offset;
+            _batch.offset = end;
+            _batch.firstCell += count;
+            _batch.numChunks -= count;
+            if (_batch.numChunks == 0)
+                _batch = Batch();
+
+            needed -= count;
+            _next += count;
+        }
+
+        _output.resize(size);
+        size_t offset = 0;
+        for (const Range& range : ranges)
+        {
+            const brain::Synapses& synapses = *range.synapses;
+            const size_t count = range.end - range.begin;
+            _output.setPositions(offset, count,
+                                 synapses.preSurfaceXPositions() + range.begin,
+                                 synapses.preSurfaceYPositions() + range.begin,
+                                 synapses.preSurfaceZPositions() +
+                                     range.begin);
+            const brion::uint16_ts& groups =
+                _computeGroups(synapses, range.begin, range.end);
+            if (!groups.empty())
+                _output.setGroups(offset, groups.size(), groups.data());
+            if (_cacheWriter)
+                _cacheWriter->append(synapses, range.begin, range.end,
+                                     range.cells, range.numCells,
+                                     groups.empty() ? nullptr
+                                                    : groups.data());
+            offset += count;
+        }
+
+        // after appending the last batches to the cache
+        if (_next == _numChunks)
+            _finishReaders();
+
+        _output.setRadii(0, size, /*radius*/ 0.f);
+        _output.setValues(0, size, /*value*/ 1.f);
+
+        return size;
+    }
+
+    /** Pop the next batch of the reader of the cell _next into _batch */
+    void _popBatch()
+    {
+        while (_next >= _firstChunks[_reader + 1])
+            ++_reader;
+
+        BatchQueue& queue = *_queues[_reader];
+        _maxQueueDepth = std::max(_maxQueueDepth, queue.getSize());
+        lunchbox::Clock clock;
+        _batch = queue.pop();
+        _loaderWaitTime += clock.getTimed();
+
+        if (_batch.error)
+        {
+            const std::exception_ptr error = _batch.error;
+            _stopReaders();
+            std::rethrow_exception(error);
+        }
+    }
+
+    /** Start reading the synapses of the cells from the given one */
+    void _startReaders(const size_t chunkIndex)
+    {
+        _stopReaders();
+
+        // only a pass over all synapses from the first chunk is cached
+        if (!_cachePath.empty() && chunkIndex == 0)
+            _cacheWriter.reset(new CacheWriter(_cachePath));
+
+        _next = chunkIndex;
+        _reader = 0;
+        _readerWaitTime = 0;
+        _loaderWaitTime = 0.;
+        _maxQueueDepth = 0;
+
+        // one reader per part of the cells after chunkIndex
+        _streams.reserve(_cells.size());
+        for (size_t i = 0; i < _cells.size(); ++i)
+        {
+            _queues.emplace_back(new BatchQueue(_readAhead));
+            if (_firstChunks[i + 1] <= chunkIndex)
+                continue;
+
+            const size_t firstCell =
+                chunkIndex > _firstChunks[i] ? chunkIndex - _firstChunks[i]
+                                             : 0;
+            const brain::GIDSet gids(_cells[i].begin() + firstCell,
+                                     _cells[i].end());
+            _streams.emplace_back(_loadSynapseStream(gids));
+
+            brain::SynapsesStream* stream = &_streams.back();
+            BatchQueue* queue = _queues.back().get();
+            _readers.push_back(
+                std::async(std::launch::async, [this, stream, queue,
+                                                firstCell] {
+                    _read(*stream, *queue, firstCell);
+                }));
+        }
+    }
+
+    void _read(brain::SynapsesStream& stream, BatchQueue& queue,
+               size_t firstCell)
     {
-        // prefetching the next chunk (instead of synchronously waiting here)
-        // turned out to be slower in real life...
-        const brain::Synapses synapses = _synapses.read(numChunks).get();
-        if (_synapses.eos())
-            _synapses = _loadSynapseStream();
-        _output.resize(synapses.size());
-        const float* __restrict__ posx = synapses.preSurfaceXPositions();
-        const float* __restrict__ posy = synapses.preSurfaceYPositions();
-        const float* __restrict__ posz = synapses.preSurfaceZPositions();
-        for (size_t i = 0; i < synapses.size(); ++i)
-            _output.update(i, Vector3f(posx[i], posy[i], posz[i]),
-                           /*radius*/ 0.f, /*value*/ 1.f);
+        while (!stream.eos())
+        {
+            Batch batch;
+            batch.firstCell = firstCell;
+            try
+            {
+                const size_t remaining = stream.getRemaining();
+                auto synapses = stream.read(_readSize);
+                batch.numChunks = remaining - stream.getRemaining();
+                batch.synapses.reset(new brain::Synapses(synapses.get()));
+            }
+            catch (...)
+            {
+                batch.error = std::current_exception();
+            }
+            firstCell += batch.numChunks;
 
-        return synapses.size();
+            lunchbox::Clock clock;
+            const bool queued = queue.push(batch);
+            _readerWaitTime += uint64_t(clock.getTimed() * 1000.);
+            if (!queued || batch.error)
+                return;
+        }
+    }
+
+    /** Wait for readers which have read all their synapses */
+    void _finishReaders()
+    {
+        for (auto& reader : _readers)
+            reader.get();
+        _readers.clear();
+        _streams.clear();
+
+        LBINFO << "Read synapses of " << _numChunks << " cells with "
+               << _cells.size() << " reader(s), max queue depth "
+               << _maxQueueDepth << "/" << _readAhead
+               << ", readers waited " << _readerWaitTime / 1000
+               << " ms, voxelization waited " << _loaderWaitTime << " ms"
+               << std::endl;
+
+        if (_cacheWriter && _cacheWriter->commit(_numChunks, _cacheBoundingBox,
+                                                 _output.getNumGroups()))
+            LBINFO << "Wrote synapse cache " << _cachePath << std::endl;
+        _cacheWriter.reset();
+    }
+
+    /** Interrupt and wait for all readers */
+    void _stopReaders()
+    {
+        // closing the queues unblocks the readers waiting on a full queue
+        for (auto& queue : _queues)
+            queue->close();
+        for (auto& reader : _readers)
+            reader.wait();
+        _readers.clear();
+        _streams.clear();
+        _queues.clear();
+        _batch = Batch();
+        _cacheWriter.reset();
+    }
+
+    /** @return the number of batches waiting to be loaded */
+    size_t getQueueDepth() const
+    {
+        size_t depth = 0;
+        for (const auto& queue : _queues)
+            depth += queue->getSize();
+        return depth;
     }
 
     EventSource& _output;
-    const brain::Circuit _circuit;
+    std::unique_ptr<brain::Circuit> _circuit; // only opened without cache
     const brain::GIDSet _preGIDs;
-    const brain::GIDSet _postGIDs;
-    brain::SynapsesStream _synapses;
-    const size_t _numChunks;
+    const GIDMapping _preMapping;
+    brion::uint16_ts _preGroups; // group of each of _preGIDs, if grouped
+    brion::uint16_ts _groups;    // groups of a batch in load()
+    std::vector<brion::uint32_ts> _cells; // postsynaptic cells of each reader
+    brion::size_ts _firstChunks; // first chunk of each reader, and the total
+    const size_t _readSize;
+    const size_t _readAhead;
+    size_t _numChunks;
+
+    std::vector<brain::SynapsesStream> _streams;
+    std::vector<std::unique_ptr<BatchQueue>> _queues; // one per reader
+    std::vector<std::future<void>> _readers;
+    size_t _next;   // next chunk of the readers
+    size_t _reader; // reader of the next chunk
+    Batch _batch;   // batch of the next chunk, if popped
+
+    std::atomic<uint64_t> _readerWaitTime; // us
+    double _loaderWaitTime;                // ms
+    size_t _maxQueueDepth;
+
+    std::string _cachePath;
+    AABBf _cacheBoundingBox;
+    std::unique_ptr<lunchbox::MemoryMap> _cacheFile;
+    const CacheHeader* _cacheHeader = nullptr;
+    std::unique_ptr<CacheWriter> _cacheWriter;
 };
 
 SynapseLoader::SynapseLoader(const URIHandler& params)
@@ -96,6 +710,7 @@ SynapseLoader::SynapseLoader(const URIHandler& params)
 
 SynapseLoader::~SynapseLoader()
 {
+    finishPrefetch();
 }
 
 Vector2f SynapseLoader::_getTimeRange() const
@@ -112,4 +727,14 @@ size_t SynapseLoader::_getNumChunks() const
 {
     return _impl->_numChunks;
 }
+
+SynapseLoader::ReadStatistics SynapseLoader::getReadStatistics() const
+{
+    ReadStatistics stats;
+    stats.queueDepth = _impl->getQueueDepth();
+    stats.maxQueueDepth = _impl->_maxQueueDepth;
+    stats.readerWaitTime = _impl->_readerWaitTime / 1000.;
+    stats.loaderWaitTime = _impl->_loaderWaitTime;
+    return stats;
+}
 }
@@ -25,7 +25,21 @@
 
 namespace fivox
 {
-/** Loads BBP synapse files to be sampled by an EventFunctor. */
+/**
+ * Loads BBP synapse files to be sampled by an EventFunctor.
+ *
+ * Each chunk holds the synapses of one postsynaptic cell. The cells are split
+ * into contiguous parts, each read by a background thread into its own bounded
+ * queue of batches, which load() drains in cell order. Loading other chunks
+ * than the ones following the previous load() restarts the readers. The queue
+ * depth, batch size and number of reader threads are set by the readAhead,
+ * readSize and readers URI parameters.
+ *
+ * If enabled, the positions of a complete pass over the synapses are cached on
+ * disk, keyed by the circuit files and the pre- and postsynaptic cells. Later
+ * loaders with the same key map the cache file instead of opening the
+ * circuit. See the cache, cacheDir and cacheSize URI parameters.
+ */
 class SynapseLoader : public EventSource
 {
 public:
@@ -39,6 +53,23 @@ public:
     FIVOX_API explicit SynapseLoader(const URIHandler& params);
     FIVOX_API virtual ~SynapseLoader();
 
+    /** Statistics of reading the synapses since the first chunk was loaded */
+    struct ReadStatistics
+    {
+        size_t queueDepth;     //!< number of batches waiting to be loaded
+        size_t maxQueueDepth;  //!< maximum number of batches waiting
+        double readerWaitTime; //!< ms the readers waited on a full queue
+        double loaderWaitTime; //!< ms load() waited on an empty queue
+    };
+
+    /**
+     * @return the statistics of the background reading, to tune the URI
+     *         parameters for a filesystem. A full queue and long reader wait
+     *         times indicate voxelization as the bottleneck, an empty queue and
+     *         long load wait times reading.
+     */
+    FIVOX_API ReadStatistics getReadStatistics() const;
+
 private:
     /** @name Abstract interface implementation */
     //@{
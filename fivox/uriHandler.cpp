@@ -20,14 +20,13 @@
  */
 
 #include "uriHandler.h"
+#include "cache.h"
 
 #include <fivox/compartmentLoader.h>
 #include <fivox/densityFunctor.h>
 #include <fivox/fieldFunctor.h>
 #include <fivox/frequencyFunctor.h>
-#ifdef FIVOX_USE_LFP
-#include <fivox/lfp/lfpFunctor.h>
-#endif
+#include <fivox/lfpFunctor.h>
 #ifdef FIVOX_USE_CUDA
 #include <fivox/cudaImageSource.h>
 #endif
@@ -42,6 +41,7 @@
 #include <BBP/TestDatasets.h>
 #endif
 #include <boost/lexical_cast.hpp>
+#include <lunchbox/clock.h>
 #include <lunchbox/file.h>
 #include <lunchbox/log.h>
 #include <lunchbox/uri.h>
@@ -49,6 +49,17 @@
 #include <brain/circuit.h>
 #include <brion/blueConfig.h>
 
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#include <unistd.h>
+
 namespace fivox
 {
 namespace
@@ -57,9 +68,31 @@ using boost::lexical_cast;
 const double _duration = 1.0;
 const double _dt = -1.0; // loaders use experiment/report dt
 const size_t _maxBlockSize = LB_64MB;
+const size_t _frameCacheSize = 1024 * LB_1MB;
+const size_t _brickCacheSize = 1024 * LB_1MB;
+const size_t _cacheSize = 8192 * LB_1MB;
 const float _cutoff = 100.0f; // micrometers
 const float _extend = 0.f;    // micrometers
 const float _gidFraction = 1.f;
+const size_t _readAhead = 4; // batches of read synapses
+const size_t _readSize = 16; // cells per read of synapses
+const size_t _numReaders = 1;
+
+std::string _getDefaultCacheDir()
+{
+    const char* dir = ::getenv("FIVOX_CACHE_DIR");
+    if (dir)
+        return dir;
+    const char* home = ::getenv("HOME");
+    return home ? std::string(home) + "/.cache/fivox" : std::string();
+}
+
+/** The backends selected by calibration, by backend cache key */
+struct CalibratedBackends
+{
+    std::mutex mutex;
+    std::map<std::string, std::string> backends;
+};
 }
 
 class URIHandler::Impl
@@ -98,16 +131,23 @@ public:
                        ? circuit.getGIDs(target)
                        : circuit.getRandomGIDs(gidFraction, target);
 
-            if (!preTarget.empty())
+            // comma-separated list of presynaptic targets
+            std::istringstream targets(preTarget);
+            std::string name;
+            while (std::getline(targets, name, ','))
             {
-                preGIDs = gidFraction == 1.f
-                              ? circuit.getGIDs(preTarget)
-                              : circuit.getRandomGIDs(gidFraction, preTarget);
+                const brion::GIDSet& targetGIDs =
+                    gidFraction == 1.f
+                        ? circuit.getGIDs(name)
+                        : circuit.getRandomGIDs(gidFraction, name);
 
-                if (preGIDs.empty())
+                if (targetGIDs.empty())
                     LBTHROW(std::runtime_error(
-                        "No GIDs found for requested target '" + preTarget +
-                        "'"));
+                        "No GIDs found for requested target '" + name + "'"));
+
+                preTargets.push_back(name);
+                preTargetGIDs.push_back(targetGIDs);
+                preGIDs.insert(targetGIDs.begin(), targetGIDs.end());
             }
         }
 
@@ -141,6 +181,14 @@ public:
         return preGIDs;
     }
 
+    const std::vector<brion::GIDSet>& getPreTargetGIDs() const
+    {
+        if (!config)
+            LBTHROW(std::runtime_error("BlueConfig was not loaded"));
+
+        return preTargetGIDs;
+    }
+
     std::string getReport() const
     {
         const std::string& report(_get("report"));
@@ -227,6 +275,19 @@ public:
         return _get("maxBlockSize", _maxBlockSize);
     }
 
+    size_t getFrameCacheSize() const
+    {
+        return _get("frameCacheSize", _frameCacheSize);
+    }
+
+    size_t getBrickCacheSize() const
+    {
+        return _get("brickCacheSize", _brickCacheSize);
+    }
+
+    std::string getBrickCacheDir() const { return _get("brickCacheDir"); }
+    bool getEventLOD() const { return _get("eventLOD", true); }
+
     float getCutoffDistance() const
     {
         return std::max(_get("cutoff", _cutoff), 0.f);
@@ -240,6 +301,29 @@ public:
     float getGIDFraction() const { return _get("gidFraction", _gidFraction); }
     std::string getReferenceVolume() const { return _get("reference"); }
     size_t getSizeInVoxel() const { return _get("size", 0); }
+    size_t getReadAhead() const
+    {
+        return std::max(_get("readAhead", _readAhead), size_t(1));
+    }
+    size_t getReadSize() const
+    {
+        return std::max(_get("readSize", _readSize), size_t(1));
+    }
+    size_t getNumReaders() const
+    {
+        return std::max(_get("readers", _numReaders), size_t(1));
+    }
+    std::string getGroupBy() const { return _get("groupBy"); }
+    std::string getBackend() const { return _get("backend"); }
+    std::string getCacheDir() const
+    {
+        // opt-in, not to fill up home directories by default
+        const std::string& dir = _get("cacheDir");
+        if (!_get("cache", !dir.empty()))
+            return std::string();
+        return dir.empty() ? _getDefaultCacheDir() : dir;
+    }
+    size_t getCacheSize() const { return _get("cacheSize", _cacheSize); }
     std::string getDescription() const
     {
         std::stringstream desc;
@@ -330,6 +414,10 @@ public:
         }
     }
 
+    // for image sources created from the same parameters, e.g. the pipelines
+    // of the Livre data source, with backend=auto and without disk cache
+    CalibratedBackends calibratedBackends;
+
 private:
     std::string _get(const std::string& param) const
     {
@@ -361,6 +449,8 @@ private:
     std::unique_ptr<brion::BlueConfig> config;
     brion::GIDSet gids;
     brion::GIDSet preGIDs;
+    brion::Strings preTargets;
+    std::vector<brion::GIDSet> preTargetGIDs; // per preTargets entry
 };
 
 // bool specialization: param present with no value = true
@@ -410,11 +500,31 @@ const brion::GIDSet& URIHandler::getGIDs() const
     return _impl->getGIDs();
 }
 
+void URIHandler::setGIDs(const brion::GIDSet& gids)
+{
+    _impl->gids = gids;
+}
+
 const brion::GIDSet& URIHandler::getPreGIDs() const
 {
     return _impl->getPreGIDs();
 }
 
+const brion::Strings& URIHandler::getPreTargets() const
+{
+    return _impl->preTargets;
+}
+
+const std::vector<brion::GIDSet>& URIHandler::getPreTargetGIDs() const
+{
+    return _impl->getPreTargetGIDs();
+}
+
+std::string URIHandler::getGroupBy() const
+{
+    return _impl->getGroupBy();
+}
+
 std::string URIHandler::getReport() const
 {
     return _impl->getReport();
@@ -455,6 +565,26 @@ size_t URIHandler::getMaxBlockSize() const
     return _impl->getMaxBlockSize();
 }
 
+size_t URIHandler::getFrameCacheSize() const
+{
+    return _impl->getFrameCacheSize();
+}
+
+size_t URIHandler::getBrickCacheSize() const
+{
+    return _impl->getBrickCacheSize();
+}
+
+std::string URIHandler::getBrickCacheDir() const
+{
+    return _impl->getBrickCacheDir();
+}
+
+bool URIHandler::getEventLOD() const
+{
+    return _impl->getEventLOD();
+}
+
 float URIHandler::getCutoffDistance() const
 {
     return _impl->getCutoffDistance();
@@ -485,6 +615,36 @@ size_t URIHandler::getSizeInVoxel() const
     return _impl->getSizeInVoxel();
 }
 
+size_t URIHandler::getReadAhead() const
+{
+    return _impl->getReadAhead();
+}
+
+size_t URIHandler::getReadSize() const
+{
+    return _impl->getReadSize();
+}
+
+size_t URIHandler::getNumReaders() const
+{
+    return _impl->getNumReaders();
+}
+
+std::string URIHandler::getCacheDir() const
+{
+    return _impl->getCacheDir();
+}
+
+size_t URIHandler::getCacheSize() const
+{
+    return _impl->getCacheSize();
+}
+
+std::string URIHandler::getBackend() const
+{
+    return _impl->getBackend();
+}
+
 std::string URIHandler::getDescription() const
 {
     return _impl->getDescription();
@@ -505,7 +665,7 @@ std::string URIHandler::getHelp()
 Parameters for all types :
 - BlueConfig: BlueConfig absolute file path (default: BBPTestData)
 - target: name of the BlueConfig target (default: CircuitTarget)
-- preTarget: target for presynaptic neurons for synapse densities (default: unset)
+- preTarget: target for presynaptic neurons for synapse densities, or a comma-separated list of targets (default: unset)
 - postTarget: target for postsynaptic neurons for synapse densities (default: unset)
 - gidFraction: take random cells from a fraction [0,1] of the given target (default: 1)
 - inputMin/inputMax: minimum and maximum input values to be considered for rescaling
@@ -517,11 +677,20 @@ Parameters for all types :
              [-100000.0, 300.0] for VSD)
 - functor: type of functor to sample the data into the voxels (defaults: 'density' for Synapses, 'frequency' for Spikes, 'field' for Compartments, Somas and VSD)
 - maxBlockSize: maximum memory usage allowed for one block in bytes (default: 64MB)
+- frameCacheSize: maximum memory usage in bytes of the loaded frames kept to revisit timesteps without loading them again, used by the Livre data source for sources loaded in one chunk; 0 disables it (default: 1GB)
+- brickCacheSize: maximum memory usage in bytes of the bricks kept by the Livre data source to serve repeated requests without sampling them again; 0 disables it (default: 1GB)
+- brickCacheDir: local directory to write the bricks evicted from the brick cache to, and to read them back from when requested again; trimmed to cacheSize (default: unset, evicted bricks are dropped)
+- eventLOD: sample the coarse levels of the Livre data source with the events merged per voxel of the level instead of all events, for sources loaded in one chunk (default: 1)
 - cutoff: the cutoff distance in micrometers (default: 100)
 - extend: the additional distance, in micrometers, by which the original data volume will be extended in every dimension (default: 0, the volume extent matches the bounding box of the data events). Changing this parameter will result in more volumetric data, and therefore more computation time
 - reference: path to a reference volume to take its size and resolution, overwrites the 'size' and 'resolution' parameter
 - size: size in voxels along the largest dimension of the volume, overwrites the 'resolution' parameter
 - resolution: number of voxels per micrometer (default: 0.0625 for densities, otherwise 0.1)
+- groupBy: voxelize groups of events into separate output volumes in a single pass over the data: 'mtype' or 'layer' of the cells for compartments, somas and spikes, 'preTarget' for each target of the preTarget list for synapses (default: unset)
+- cache: cache loaded data, e.g. event and synapse positions, on disk to speed up later runs (default: 0, 1 if cacheDir is set)
+- cacheDir: directory of the cache files (default: $FIVOX_CACHE_DIR or ~/.cache/fivox)
+- cacheSize: maximum size in bytes of the files in cacheDir, and in brickCacheDir, the least recently used ones are removed first (default: 8GB)
+- backend: implementation of the sampling with a functor: 'voxel' for one voxel at a time, 'row' for rows of voxels at once (LFP), 'cuda' (LFP), or 'auto' to select the fastest on a sample of the volume, cached per machine, functor and number of events (default: the first available of 'cuda', 'row' and 'voxel')
 
 Parameters for Compartments:
 - report: name of the compartment report (default: 'voltage'; 'allvoltage' if BlueConfig is BBPTestData)
@@ -535,6 +704,11 @@ Parameters for Spikes:
 - duration: time window in milliseconds to load spikes (default: 1)
 - spikes: path to an alternate out.dat/out.spikes file (default: SpikesPath specified in the BlueConfig)
 
+Parameters for Synapses:
+- readAhead: number of batches of synapses each reader reads ahead of the voxelization (default: 4)
+- readSize: number of cells per batch of synapses (default: 16)
+- readers: number of threads reading synapses in parallel (default: 1)
+
 Parameters for VSD:
 - report: name of the voltage report (default: 'soma'; 'voltage' if BlueConfig is BBPTestData)
 - areas: path to an area report file (default: path to TestData areas if BlueConfig is BBPTestData)
@@ -542,11 +716,240 @@ Parameters for VSD:
     //! [VolumeParameters]
 }
 
+namespace
+{
+// implementations of the sampling with a functor, in order of preference
+const brion::Strings _backends{"cuda", "row", "voxel"};
+
+// event-voxel pairs sampled for the calibration of a backend
+const size_t _calibrationPairs = 50000000;
+const size_t _maxCalibrationRow = 256;
+const size_t _maxCalibrationRows = 16;
+
+bool _hasCUDADevice()
+{
+#ifdef FIVOX_USE_CUDA
+    int deviceCount = 0;
+    if (cudaGetDeviceCount(&deviceCount) != cudaSuccess)
+        deviceCount = 0;
+    return deviceCount > 0;
+#else
+    return false;
+#endif
+}
+
+template <class TImage>
+bool _isSupported(const std::string& backend, const URIHandler& params,
+                  const EventFunctor<TImage>& functor,
+                  const EventSource& eventSource)
+{
+    // only the voxel backend samples event groups
+    if (backend == "voxel")
+        return true;
+    if (eventSource.getNumGroups() > 1)
+        return false;
+    if (backend == "row")
+        return functor.supportsRows();
+    if (backend == "cuda")
+        return params.getFunctorType() == FunctorType::lfp && _hasCUDADevice();
+    return false;
+}
+
+template <class TImage>
+ImageSourcePtr<TImage> _newBackend(const std::string& backend,
+                                   const URIHandler& params,
+                                   EventSourcePtr eventSource)
+{
+#ifdef FIVOX_USE_CUDA
+    if (backend == "cuda")
+        return CudaImageSource<TImage>::New();
+#endif
+    auto source = FunctorImageSource<TImage>::New();
+    auto functor = params.newFunctor<TImage>();
+    functor->setEventSource(eventSource);
+    source->setFunctor(functor);
+    source->setRowSampling(backend == "row");
+    return source;
+}
+
+/**
+ * @return the time in ms to voxelize rows of the volume around the center of
+ *         the events with the given backend, sampling the events loaded by the
+ *         caller.
+ */
+template <class TImage>
+float _calibrate(const std::string& backend, const URIHandler& params,
+                 EventSourcePtr eventSource, size_t& numPairs)
+{
+    ImageSourcePtr<TImage> source =
+        _newBackend<TImage>(backend, params, eventSource);
+    source->setEventSource(eventSource);
+    source->setLoadEvents(false);
+    source->setup(params);
+
+    // shorter rows for many events, to sample at most _calibrationPairs
+    // unless a single voxel samples more events
+    const size_t numEvents = std::max(eventSource->getNumEvents(), size_t(1));
+    const size_t rowSize = std::max<size_t>(
+        std::min<size_t>({std::max(source->getSizeInVoxel()[0], 1u),
+                          _maxCalibrationRow, _calibrationPairs / numEvents}),
+        1);
+    const size_t numRows =
+        std::max<size_t>(std::min(_calibrationPairs / (numEvents * rowSize),
+                                  _maxCalibrationRows),
+                         1);
+    numPairs = numEvents * rowSize * numRows;
+
+    typename TImage::SizeType size;
+    size[0] = rowSize;
+    size[1] = 1;
+    size[2] = numRows;
+    typename TImage::RegionType region;
+    region.SetSize(size);
+
+    typename TImage::SpacingType spacing;
+    typename TImage::PointType origin;
+    const Vector3f& center = eventSource->getBoundingBox().getCenter();
+    for (size_t i = 0; i < 3; ++i)
+    {
+        spacing[i] = 1.f / source->getResolution()[i];
+        origin[i] = center[i] - 0.5f * size[i] * spacing[i];
+    }
+
+    auto volume = source->GetOutput();
+    volume->SetRegions(region);
+    volume->SetSpacing(spacing);
+    volume->SetOrigin(origin);
+
+    lunchbox::Clock clock;
+    source->Update();
+    return clock.getTimef();
+}
+
+/** @return the key of the backend cache for the given volume */
+template <class TImage>
+cache::Key _getBackendKey(const URIHandler& params,
+                          const EventSource& eventSource)
+{
+    char hostname[256] = {0};
+    ::gethostname(hostname, sizeof(hostname) - 1);
+
+    // the number of events rounded to a power of two
+    size_t numEvents = 1;
+    while (numEvents < eventSource.getNumEvents())
+        numEvents <<= 1;
+
+    cache::Key key;
+    key << std::string("backend") << std::string(hostname)
+        << uint64_t(std::thread::hardware_concurrency())
+        << uint64_t(params.getFunctorType()) << params.getCutoffDistance()
+        << uint64_t(numEvents)
+        << uint64_t(sizeof(typename TImage::PixelType));
+    return key;
+}
+
+/**
+ * @return the fastest backend on a sample of the volume, calibrated once per
+ *         parameters and cached on disk
+ */
+template <class TImage>
+std::string _selectBackend(const URIHandler& params, EventSourcePtr eventSource,
+                           const brion::Strings& candidates,
+                           CalibratedBackends& calibrated)
+{
+    if (candidates.size() == 1)
+        return candidates.front();
+
+    const cache::Key& key = _getBackendKey<TImage>(params, *eventSource);
+    const std::lock_guard<std::mutex> lock(calibrated.mutex);
+    std::string& best = calibrated.backends[key.getString()];
+    if (!best.empty())
+        return best;
+
+    const std::string& path = cache::getPath(params, "backend", key);
+    if (cache::exists(path))
+    {
+        std::ifstream file(path);
+        std::string backend;
+        if (file >> backend &&
+            std::find(candidates.begin(), candidates.end(), backend) !=
+                candidates.end())
+        {
+            LBINFO << "Using calibrated " << backend << " backend from "
+                   << path << std::endl;
+            best = backend;
+            return best;
+        }
+    }
+
+    // load the events once, so the first backend is not slowed down by it
+    eventSource->load();
+
+    float bestTime = std::numeric_limits<float>::max();
+    for (const std::string& backend : candidates)
+    {
+        size_t numPairs = 0;
+        const float time =
+            _calibrate<TImage>(backend, params, eventSource, numPairs);
+        LBINFO << "Backend " << backend << ": "
+               << numPairs / std::max(time, 1e-3f) / 1000.f
+               << " M event-voxel pairs/s" << std::endl;
+        if (time < bestTime)
+        {
+            best = backend;
+            bestTime = time;
+        }
+    }
+
+    if (!path.empty())
+        cache::write(path, {cache::Block(best.data(), best.size())});
+    return best;
+}
+
+template <class TImage>
+ImageSourcePtr<TImage> _newFunctorSource(const URIHandler& params,
+                                         EventSourcePtr eventSource,
+                                         CalibratedBackends& calibrated)
+{
+    const auto functor = params.newFunctor<TImage>();
+    brion::Strings candidates;
+    for (const std::string& backend : _backends)
+        if (_isSupported(backend, params, *functor, *eventSource))
+            candidates.push_back(backend);
+
+    std::string backend = params.getBackend();
+    if (backend == "auto")
+        backend = _selectBackend<TImage>(params, eventSource, candidates,
+                                         calibrated);
+    else if (backend.empty())
+        backend = candidates.front();
+    else if (std::find(candidates.begin(), candidates.end(), backend) ==
+             candidates.end())
+    {
+        LBWARN << "Backend " << backend << " not available, using "
+               << candidates.front() << std::endl;
+        backend = candidates.front();
+    }
+
+    if (backend == "cuda")
+        LBINFO << "CUDA-capable device is detected. "
+               << "Using GPU implementation." << std::endl;
+    else
+        LBINFO << "Using " << backend << " backend" << std::endl;
+    return _newBackend<TImage>(backend, params, eventSource);
+}
+}
+
 template <class TImage>
 ImageSourcePtr<TImage> URIHandler::newImageSource() const
 {
-    EventSourcePtr eventSource = newEventSource();
+    return newImageSource<TImage>(newEventSource());
+}
 
+template <class TImage>
+ImageSourcePtr<TImage> URIHandler::newImageSource(
+    EventSourcePtr eventSource) const
+{
     ImageSourcePtr<TImage> source;
     switch (getFunctorType())
     {
@@ -554,31 +957,8 @@ ImageSourcePtr<TImage> URIHandler::newImageSource() const
         source = EventValueSummationImageSource<TImage>::New();
         break;
     default:
-#ifdef FIVOX_USE_CUDA
-        bool cudaCapable = false;
-        if (getFunctorType() == FunctorType::lfp)
-        {
-            int deviceCount = 0;
-            if (cudaGetDeviceCount(&deviceCount) != cudaSuccess)
-                deviceCount = 0;
-
-            cudaCapable = deviceCount > 0;
-            if (cudaCapable)
-            {
-                LBINFO << "CUDA-capable device is detected. "
-                       << "Using GPU implementation." << std::endl;
-                source = CudaImageSource<TImage>::New();
-            }
-        }
-        if (!cudaCapable)
-#endif
-        {
-            auto functorSource = FunctorImageSource<TImage>::New();
-            auto functor = newFunctor<TImage>();
-            functorSource->setFunctor(functor);
-            functor->setEventSource(eventSource);
-            source = functorSource;
-        }
+        source = _newFunctorSource<TImage>(*this, eventSource,
+                                           _impl->calibratedBackends);
     }
 
     LBINFO << "Ready to voxelize " << *this << ", dt = " << eventSource->getDt()
@@ -621,10 +1001,8 @@ EventFunctorPtr<TImage> URIHandler::newFunctor() const
         return std::make_shared<FieldFunctor<TImage>>();
     case FunctorType::frequency:
         return std::make_shared<FrequencyFunctor<TImage>>();
-#ifdef FIVOX_USE_LFP
     case FunctorType::lfp:
         return std::make_shared<LFPFunctor<TImage>>();
-#endif
     case FunctorType::unknown:
     default:
         return nullptr;
@@ -644,6 +1022,10 @@ template fivox::ImageSourcePtr<fivox::ByteVolume>
     fivox::URIHandler::newImageSource() const;
 template fivox::ImageSourcePtr<fivox::FloatVolume>
     fivox::URIHandler::newImageSource() const;
+template fivox::ImageSourcePtr<fivox::ByteVolume>
+    fivox::URIHandler::newImageSource(fivox::EventSourcePtr) const;
+template fivox::ImageSourcePtr<fivox::FloatVolume>
+    fivox::URIHandler::newImageSource(fivox::EventSourcePtr) const;
 template fivox::EventFunctorPtr<fivox::ByteVolume>
     fivox::URIHandler::newFunctor() const;
 template fivox::EventFunctorPtr<fivox::FloatVolume>
@@ -69,15 +69,37 @@ public:
      *         'Layer1' otherwise.
      *         If the specified target was the '*' wildcard, it returns all GIDs
      *         of the circuit and omits target parsing entirely.
+     *         The GIDs given to setGIDs() if called.
      */
     FIVOX_API const brion::GIDSet& getGIDs() const;
 
+    /**
+     * Restrict the cells of the sources created afterwards, e.g. to the cells
+     * near a part of the volume.
+     *
+     * @param gids the cells to use instead of the ones of the target.
+     */
+    FIVOX_API void setGIDs(const brion::GIDSet& gids);
+
     /**
      * @return the GIDs from the 'preTarget' parameter, used for synapse
-     *         projections. Empty if parameter not specified.
+     *         projections. Empty if parameter not specified. The union of all
+     *         targets if 'preTarget' is a comma-separated list.
      */
     FIVOX_API const brion::GIDSet& getPreGIDs() const;
 
+    /** @return the names of the targets in the 'preTarget' list. */
+    FIVOX_API const brion::Strings& getPreTargets() const;
+
+    /** @return the GIDs of each target in the 'preTarget' list. */
+    FIVOX_API const std::vector<brion::GIDSet>& getPreTargetGIDs() const;
+
+    /**
+     * @return the criterion to group events into separate output channels,
+     *         'mtype', 'layer' or 'preTarget'. Empty by default, no grouping.
+     */
+    FIVOX_API std::string getGroupBy() const;
+
     /**
      * Get the specified report name.
      *
@@ -142,6 +164,36 @@ public:
      */
     FIVOX_API size_t getMaxBlockSize() const;
 
+    /**
+     * Get the memory budget for loaded frames kept in memory (bytes), used by
+     * the Livre data source to revisit timesteps without loading them again.
+     *
+     * @return the specified frame cache size. If invalid or empty, return 1GB,
+     *         0 disables the cache
+     */
+    FIVOX_API size_t getFrameCacheSize() const;
+
+    /**
+     * Get the memory budget for sampled bricks kept in memory (bytes), used by
+     * the Livre data source to serve repeated requests of a brick.
+     *
+     * @return the specified brick cache size. If invalid or empty, return 1GB,
+     *         0 disables the cache
+     */
+    FIVOX_API size_t getBrickCacheSize() const;
+
+    /**
+     * @return the directory for the bricks evicted from the brick cache, or an
+     *         empty string if they are dropped.
+     */
+    FIVOX_API std::string getBrickCacheDir() const;
+
+    /**
+     * @return true if the coarse levels of the Livre data source sample the
+     *         events merged per voxel, see EventLOD (default: true).
+     */
+    FIVOX_API bool getEventLOD() const;
+
     /**
      * Get the specified cutoff distance in micrometers.
      *
@@ -188,6 +240,45 @@ public:
     /** @return the size in voxels along the largest dimension of the volume. */
     FIVOX_API size_t getSizeInVoxel() const;
 
+    /**
+     * @return the number of batches of synapses each reader reads ahead of
+     *         their voxelization. If invalid or empty, return 4.
+     */
+    FIVOX_API size_t getReadAhead() const;
+
+    /**
+     * @return the number of cells whose synapses are read at once. If invalid
+     *         or empty, return 16.
+     */
+    FIVOX_API size_t getReadSize() const;
+
+    /**
+     * @return the number of threads reading synapses in parallel. If invalid
+     *         or empty, return 1.
+     */
+    FIVOX_API size_t getNumReaders() const;
+
+    /**
+     * @return the directory of the on-disk caches of loaded data, or an empty
+     *         string if caching is disabled, which is the default unless
+     *         'cache' or 'cacheDir' is set. If 'cacheDir' is empty, return
+     *         $FIVOX_CACHE_DIR or $HOME/.cache/fivox.
+     */
+    FIVOX_API std::string getCacheDir() const;
+
+    /**
+     * @return the maximum size in bytes of the files in the cache directory,
+     *         and in the brick cache directory. If invalid or empty, return
+     *         8GB.
+     */
+    FIVOX_API size_t getCacheSize() const;
+
+    /**
+     * @return the image source implementation for voxelizing with a functor:
+     *         'voxel', 'row', 'cuda', 'auto' or empty for the default.
+     */
+    FIVOX_API std::string getBackend() const;
+
     /** @return description of the volume from the provided URI paramters. */
     FIVOX_API std::string getDescription() const;
 
@@ -198,6 +289,14 @@ public:
     FIVOX_API template <class TImage>
     ImageSourcePtr<TImage> newImageSource() const;
 
+    /**
+     * @return a new image source for the given parameters and pixel type,
+     *         sampling the given event source. Several image sources may share
+     *         one event source, see ImageSource::setLoadEvents().
+     */
+    FIVOX_API template <class TImage>
+    ImageSourcePtr<TImage> newImageSource(EventSourcePtr eventSource) const;
+
     /** @return a new functor for the given parameters and pixel type. */
     FIVOX_API template <class TImage>
     EventFunctorPtr<TImage> newFunctor() const;
@@ -32,6 +32,7 @@
 #include <brion/brion.h>
 
 #include <cassert>
+#include <limits>
 
 namespace fivox
 {
@@ -42,31 +43,51 @@ public:
         : _output(output)
         , _circuit(params.getConfig())
         , _gids(params.getGIDs())
-        , _voltageReport(params.getConfig().getReportSource(params.getReport()),
-                         brion::MODE_READ, _gids)
-        , _areaReport(URI(params.getAreas()), brion::MODE_READ, _gids)
+        , _voltageSource(
+              params.getConfig().getReportSource(params.getReport()))
+        , _areaSource(params.getAreas())
+        , _voltageReport(_voltageSource, brion::MODE_READ, _gids)
+        , _areaReport(_areaSource, brion::MODE_READ, _gids)
+        , _mapping(helpers::computeInverseMapping(_voltageReport))
+        , _voltages(_voltageReport)
         , _restingPotential(0.f)
         , _areaMultiplier(0.f)
         , _spikeFilter(false)
         , _apThreshold(0.f)
         , _interpolate(false)
     {
-        LBINFO << "Loading " << _gids.size() << " morphologies..." << std::endl;
-        const auto morphologies =
-            _circuit.loadMorphologies(_gids,
-                                      brain::Circuit::Coordinates::global);
-
-        LBINFO << "Creating events..." << std::endl;
-        helpers::addCompartmentEvents(morphologies, _voltageReport, _output);
+        LBINFO << "Creating events of " << _gids.size() << " cells..."
+               << std::endl;
+        helpers::addCompartmentEvents(params, _circuit, _voltageReport,
+                                      _mapping, _output);
 
         LBINFO << "Loading areas..." << std::endl;
         _areas = _areaReport.loadFrame(0.).get();
     }
 
+    void setRegionOfInterest(const AABBf& region)
+    {
+        auto regionReport = helpers::selectCellsInRegion(
+            region, _voltageSource,
+            _regionReport ? *_regionReport : _voltageReport, _mapping,
+            _output);
+        if (!regionReport)
+            return;
+
+        brion::CompartmentReport areaReport(_areaSource, brion::MODE_READ,
+                                            regionReport->getGIDs());
+        _areas = areaReport.loadFrame(0.).get();
+        _gains.clear();
+        _voltages.setReport(*regionReport);
+        _regionReport = std::move(regionReport);
+    }
+
     ssize_t load()
     {
-        brion::floatsPtr voltages =
-            _voltageReport.loadFrame(_output.getCurrentTime()).get();
+        if (_output.getNumEvents() == 0)
+            return 0;
+
+        brion::floatsPtr voltages = _voltages.load(_output.getCurrentTime());
         if (!voltages)
             return -1;
 
@@ -75,32 +96,50 @@ public:
                 std::runtime_error("The number of compartments in the "
                                    "voltage report doesn't match the "
                                    "number of areas"));
-        for (size_t i = 0; i != voltages->size(); ++i)
-        {
-            const float voltage = (*voltages)[i];
-            _updateEventValue(i, _spikeFilter ? std::min(voltage, _apThreshold)
-                                              : voltage,
-                              (*_areas)[i]);
-        }
-        return voltages->size();
+        if (_gains.empty())
+            _updateGains();
+
+        // single pass over the frame, which is owned by this loader and
+        // adopted by the output afterwards
+        const float threshold =
+            _spikeFilter ? _apThreshold : std::numeric_limits<float>::max();
+        const float offset = _areaMultiplier - _restingPotential;
+        const float* gains = _gains.data();
+        float* values = voltages->data();
+        const size_t size = voltages->size();
+        for (size_t i = 0; i < size; ++i)
+            values[i] = (std::min(values[i], threshold) + offset) * gains[i];
+
+        _output.adoptValues(voltages);
+        return size;
     }
 
-    void _updateEventValue(const size_t index, const float voltage,
-                           const float area)
+    /** Compute the static factor of each event, area times attenuation */
+    void _updateGains()
     {
-        const float positionY = _output.getPositionsY()[index];
-        _output[index] = (voltage - _restingPotential + _areaMultiplier) *
-                         area * _curve.getAttenuation(positionY, _interpolate);
+        const float* positionsY = _output.getPositionsY();
+        _gains.resize(_areas->size());
+        for (size_t i = 0; i < _gains.size(); ++i)
+            _gains[i] = (*_areas)[i] *
+                        _curve.getAttenuation(positionsY[i], _interpolate);
     }
 
     EventSource& _output;
     const brain::Circuit _circuit;
     brion::GIDSet _gids;
 
+    const URI _voltageSource;
+    const URI _areaSource;
     brion::CompartmentReport _voltageReport;
     brion::CompartmentReport _areaReport;
+    // inverse mapping of the current voltage report, the region report if any
+    helpers::FlatInverseMapping _mapping;
+    // voltage report of the cells in the region of interest, if not all
+    std::unique_ptr<brion::CompartmentReport> _regionReport;
+    helpers::FrameReader<> _voltages;
     brion::floatsPtr _areas;
     AttenuationCurve _curve;
+    brion::floats _gains; // area times attenuation per event, empty if stale
 
     AABBf _bboxSomas;        // bounding box of the somas
     float _restingPotential; // resting potential (mV)
@@ -121,11 +160,13 @@ VSDLoader::VSDLoader(const URIHandler& params)
 
 VSDLoader::~VSDLoader()
 {
+    finishPrefetch();
 }
 
 void VSDLoader::setCurve(const AttenuationCurve& curve)
 {
     _impl->_curve = curve;
+    _impl->_gains.clear();
 }
 
 const brion::GIDSet& VSDLoader::getGIDs() const
@@ -161,6 +202,7 @@ void VSDLoader::setApThreshold(const float apThreshold)
 void VSDLoader::setInterpolation(const bool interpolate)
 {
     _impl->_interpolate = interpolate;
+    _impl->_gains.clear();
 }
 
 Vector2f VSDLoader::_getTimeRange() const
@@ -169,6 +211,16 @@ Vector2f VSDLoader::_getTimeRange() const
                     _impl->_voltageReport.getEndTime());
 }
 
+void VSDLoader::_prefetch(const double time)
+{
+    _impl->_voltages.prefetch(time);
+}
+
+void VSDLoader::_setRegionOfInterest(const AABBf& region)
+{
+    _impl->setRegionOfInterest(region);
+}
+
 ssize_t VSDLoader::_load(const size_t /*chunkIndex*/,
                          const size_t /*numChunks*/)
 {
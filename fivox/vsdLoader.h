@@ -110,6 +110,8 @@ private:
     ssize_t _load(size_t chunkIndex, size_t numChunks) final;
     SourceType _getType() const final { return SourceType::frame; }
     size_t _getNumChunks() const final { return 1; }
+    void _prefetch(double time) final;
+    void _setRegionOfInterest(const AABBf& region) final;
     //@}
 
     class Impl;
@@ -0,0 +1,112 @@
+/* Copyright (c) 2017, EPFL/Blue Brain Project
+ *
+ * This file is part of Fivox <https://github.com/BlueBrain/Fivox>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of Eyescale Software GmbH nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define BOOST_TEST_MODULE Cache
+
+#include "test.h"
+#include <fivox/cache.h>
+
+#include <boost/filesystem.hpp>
+
+#include <utime.h>
+
+#include <fstream>
+
+namespace
+{
+void _writeFile(const boost::filesystem::path& path, const size_t size,
+                const time_t time)
+{
+    std::ofstream(path.string()) << std::string(size, 'x');
+    const utimbuf times = {time, time};
+    ::utime(path.string().c_str(), &times);
+}
+}
+
+BOOST_AUTO_TEST_CASE(add_file)
+{
+    const boost::filesystem::path dir =
+        boost::filesystem::temp_directory_path() /
+        boost::filesystem::unique_path();
+    boost::filesystem::create_directory(dir);
+    const boost::filesystem::path file = dir / "data";
+
+    const auto getKey = [&](const std::string& path) {
+        fivox::cache::Key key;
+        return key.addFile(path).getString();
+    };
+
+    const std::string& missing = getKey(file.string());
+    _writeFile(file, 10, 1000);
+    const std::string& written = getKey(file.string());
+    const std::string& directory = getKey(dir.string());
+    BOOST_CHECK_NE(missing, written);
+    BOOST_CHECK_EQUAL(getKey(file.string()), written);
+
+    // modified in place, with the same size
+    _writeFile(file, 10, 2000);
+    BOOST_CHECK_NE(getKey(file.string()), written);
+    BOOST_CHECK_NE(getKey(dir.string()), directory);
+
+    boost::filesystem::remove_all(dir);
+}
+
+BOOST_AUTO_TEST_CASE(trim)
+{
+    const boost::filesystem::path dir =
+        boost::filesystem::temp_directory_path() /
+        boost::filesystem::unique_path();
+    boost::filesystem::create_directory(dir);
+
+    _writeFile(dir / "a", 100, 3000);
+    _writeFile(dir / "b", 100, 1000);
+    _writeFile(dir / "c", 100, 2000);
+    _writeFile(dir / "c.1234", 100, 0); // being written
+
+    fivox::cache::trim(dir.string(), 300);
+    BOOST_CHECK(boost::filesystem::exists(dir / "b"));
+
+    // a used file is kept over the older ones
+    BOOST_CHECK(fivox::cache::exists((dir / "b").string()));
+    fivox::cache::trim(dir.string(), 200);
+    BOOST_CHECK(boost::filesystem::exists(dir / "a"));
+    BOOST_CHECK(boost::filesystem::exists(dir / "b"));
+    BOOST_CHECK(!boost::filesystem::exists(dir / "c"));
+    BOOST_CHECK(boost::filesystem::exists(dir / "c.1234"));
+
+    // the file about to be used is kept even if least recently used
+    fivox::cache::trim(dir.string(), 0, (dir / "a").string());
+    BOOST_CHECK(boost::filesystem::exists(dir / "a"));
+    BOOST_CHECK(!boost::filesystem::exists(dir / "b"));
+
+    fivox::cache::trim(dir.string(), 0);
+    BOOST_CHECK(!boost::filesystem::exists(dir / "a"));
+
+    boost::filesystem::remove_all(dir);
+}
@@ -32,9 +32,13 @@
 #define BOOST_TEST_MODULE EventFunctor
 
 #include "test.h"
+#include <fivox/densityFunctor.h>
 #include <fivox/eventFunctor.h>
 #include <fivox/eventSource.h>
+#include <fivox/fieldFunctor.h>
 #include <fivox/functorImageSource.h>
+#include <fivox/genericLoader.h>
+#include <fivox/uriHandler.h>
 #include <iomanip>
 #include <itkTimeProbe.h>
 
@@ -119,3 +123,50 @@ BOOST_AUTO_TEST_CASE(EventFunctor)
         }
     }
 }
+
+BOOST_AUTO_TEST_CASE(sample_groups)
+{
+    typedef itk::Image<float, 3> Image;
+
+    const fivox::URIHandler params(fivox::URI("fivox://"));
+    auto source = std::make_shared<fivox::GenericLoader>(params);
+
+    const size_t numEvents = 1000;
+    source->resize(numEvents);
+    source->setGroupNames({"even", "odd", "empty"});
+    for (size_t i = 0; i < numEvents; ++i)
+    {
+        source->update(i, fivox::Vector3f(float(i % 10), float(i / 10 % 10),
+                                          float(i / 100)),
+                       .5f, float(i));
+        source->setGroups(i, 1, uint16_t(i % 2));
+    }
+    source->buildRTree();
+
+    Image::PointType point;
+    point.Fill(4.5f);
+    Image::SpacingType spacing;
+    spacing.Fill(4.f);
+
+    fivox::FieldFunctor<Image> field;
+    fivox::DensityFunctor<Image> density;
+    for (fivox::EventFunctor<Image>* functor :
+         std::vector<fivox::EventFunctor<Image>*>{&field, &density})
+    {
+        BOOST_REQUIRE(functor->supportsGroups());
+        functor->setEventSource(source);
+
+        // the groups split the events sampled without groups
+        std::vector<float> pixels(3, -1.f);
+        functor->sampleGroups(point, spacing, pixels.size(), pixels.data());
+        BOOST_CHECK_GT(pixels[0], 0.f);
+        BOOST_CHECK_GT(pixels[1], 0.f);
+        BOOST_CHECK_EQUAL(pixels[2], 0.f);
+        BOOST_CHECK_CLOSE(pixels[0] + pixels[1], (*functor)(point, spacing),
+                          0.01f);
+
+        // events of the groups not sampled are ignored
+        functor->sampleGroups(point, spacing, 1, pixels.data());
+        BOOST_CHECK_LT(pixels[0], (*functor)(point, spacing));
+    }
+}
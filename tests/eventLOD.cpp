@@ -0,0 +1,122 @@
+/* Copyright (c) 2017, EPFL/Blue Brain Project
+ *
+ * This file is part of Fivox <https://github.com/BlueBrain/Fivox>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of Eyescale Software GmbH nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define BOOST_TEST_MODULE EventLOD
+
+#include "test.h"
+#include <fivox/eventLOD.h>
+#include <fivox/genericLoader.h>
+#include <fivox/uriHandler.h>
+
+namespace
+{
+const size_t gridSize = 10;
+
+/** Events on a grid with a distance of 1, the value is the x index */
+fivox::EventSourcePtr _createGrid(const fivox::URIHandler& params)
+{
+    fivox::EventSourcePtr source =
+        std::make_shared<fivox::GenericLoader>(params);
+
+    const size_t numEvents = gridSize * gridSize * gridSize;
+    source->resize(numEvents);
+    brion::floats x, y, z, values;
+    for (size_t k = 0; k < gridSize; ++k)
+        for (size_t j = 0; j < gridSize; ++j)
+            for (size_t i = 0; i < gridSize; ++i)
+            {
+                x.push_back(i + .25f);
+                y.push_back(j + .25f);
+                z.push_back(k + .25f);
+                values.push_back(float(i));
+            }
+    source->setPositions(0, numEvents, x.data(), y.data(), z.data());
+    source->setRadii(0, numEvents, .5f);
+    source->setValues(0, numEvents, values.data());
+    return source;
+}
+}
+
+BOOST_AUTO_TEST_CASE(merge_levels)
+{
+    const fivox::URIHandler params(fivox::URI("fivox://"));
+    fivox::EventSourcePtr source = _createGrid(params);
+    fivox::EventLOD lod(params, source, fivox::Vector3f(0.f), 1.f);
+
+    BOOST_CHECK_EQUAL(lod.getLevel(0), source);
+
+    // cells of size 2 centered on 0, 2, ...: 6 cells along each axis
+    const fivox::EventSourcePtr level = lod.getLevel(1);
+    BOOST_REQUIRE(level);
+    BOOST_REQUIRE_EQUAL(level->getNumEvents(), 6 * 6 * 6);
+    BOOST_CHECK_EQUAL(lod.getLevel(1), level);
+
+    float sum = 0.f;
+    for (size_t i = 0; i < level->getNumEvents(); ++i)
+        sum += level->getValues()[i];
+    BOOST_CHECK_EQUAL(sum, 4500.f);
+
+    // the cells are numbered in the order of their first event
+    BOOST_CHECK_EQUAL(level->getPositionsX()[0], .25f);
+    BOOST_CHECK_EQUAL(level->getValues()[0], 0.f);
+    BOOST_CHECK_EQUAL(level->getPositionsX()[1], 1.75f);
+    BOOST_CHECK_EQUAL(level->getPositionsY()[1], .25f);
+    BOOST_CHECK_EQUAL(level->getValues()[1], 1.f + 2.f);
+    BOOST_CHECK_EQUAL(level->getRadii()[1], 1.f); // inverted cell size / 2
+
+    // values are merged again only after invalidateValues()
+    source->setValues(0, source->getNumEvents(), 1.f);
+    BOOST_CHECK_EQUAL(lod.getLevel(1)->getValues()[1], 3.f);
+    lod.invalidateValues();
+    BOOST_CHECK_EQUAL(lod.getLevel(1)->getValues()[1], 2.f);
+
+    // cells of size 16 centered on 0 and 16
+    BOOST_CHECK_EQUAL(lod.getLevel(4)->getNumEvents(), 8);
+}
+
+BOOST_AUTO_TEST_CASE(merge_maximum)
+{
+    const fivox::URIHandler params(fivox::URI("fivox://?functor=frequency"));
+    fivox::EventSourcePtr source = _createGrid(params);
+    fivox::EventLOD lod(params, source, fivox::Vector3f(0.f), 1.f);
+
+    const fivox::EventSourcePtr level = lod.getLevel(1);
+    BOOST_CHECK_EQUAL(level->getValues()[0], 0.f);
+    BOOST_CHECK_EQUAL(level->getValues()[1], 2.f);
+}
+
+BOOST_AUTO_TEST_CASE(merge_sparse_events)
+{
+    // merging would not reduce the number of events
+    const fivox::URIHandler params(fivox::URI("fivox://"));
+    fivox::EventSourcePtr source =
+        std::make_shared<fivox::GenericLoader>(params);
+    fivox::EventLOD lod(params, source, fivox::Vector3f(0.f), 1.f);
+    BOOST_CHECK_EQUAL(lod.getLevel(1), source);
+}
@@ -0,0 +1,317 @@
+/* Copyright (c) 2017, EPFL/Blue Brain Project
+ *
+ * This file is part of Fivox <https://github.com/BlueBrain/Fivox>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of Eyescale Software GmbH nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define BOOST_TEST_MODULE EventSource
+
+#include "test.h"
+#include <fivox/genericLoader.h>
+#include <fivox/uriHandler.h>
+
+#include <cstddef>
+#include <set>
+
+namespace
+{
+const size_t numChunks = 5;
+
+/** Chunk i has i + 1 events at x = i, loading the last chunk fails */
+class ChunkSource : public fivox::EventSource
+{
+public:
+    explicit ChunkSource(const fivox::URIHandler& params)
+        : fivox::EventSource(params)
+    {
+    }
+    ~ChunkSource() { finishPrefetch(); }
+
+    std::vector<size_t> loadedEvents; // getNumEvents() seen by _load()
+
+private:
+    fivox::Vector2f _getTimeRange() const final
+    {
+        return fivox::Vector2f(0.f, 1.f);
+    }
+
+    ssize_t _load(const size_t chunkIndex, const size_t count) final
+    {
+        if (chunkIndex + count == numChunks)
+            throw std::runtime_error("Failed to load the last chunk");
+
+        const size_t size = chunkIndex + 1;
+        resize(size);
+        for (size_t i = 0; i < size; ++i)
+            update(i, fivox::Vector3f(float(chunkIndex), 0.f, 0.f), 1.f, 1.f);
+        loadedEvents.push_back(getNumEvents());
+        return size;
+    }
+
+    fivox::SourceType _getType() const final
+    {
+        return fivox::SourceType::frame;
+    }
+    size_t _getNumChunks() const final { return numChunks; }
+};
+}
+
+BOOST_AUTO_TEST_CASE(bulk_update)
+{
+    const fivox::URIHandler params(fivox::URI("fivox://"));
+    fivox::GenericLoader source(params);
+
+    const size_t numEvents = 1000000;
+    source.resize(numEvents);
+    source.setBoundingBox(fivox::AABBf());
+
+    brion::floats x(numEvents), y(numEvents), z(numEvents);
+    brion::floats values(numEvents);
+    for (size_t i = 0; i < numEvents; ++i)
+    {
+        x[i] = float(i);
+        y[i] = -float(i);
+        z[i] = 1.f;
+        values[i] = float(i) * .5f;
+    }
+
+    source.setPositions(0, numEvents, x.data(), y.data(), z.data());
+    source.setRadii(0, numEvents, 2.f);
+    source.setValues(0, numEvents, values.data());
+
+    const fivox::AABBf& bbox = source.getBoundingBox();
+    BOOST_CHECK_EQUAL(bbox.getMin(),
+                      fivox::Vector3f(0.f, 1.f - numEvents, 1.f));
+    BOOST_CHECK_EQUAL(bbox.getMax(),
+                      fivox::Vector3f(numEvents - 1.f, 0.f, 1.f));
+
+    for (size_t i = 0; i < numEvents; i += 9973)
+    {
+        BOOST_CHECK_EQUAL(source.getPositionsX()[i], x[i]);
+        BOOST_CHECK_EQUAL(source.getPositionsY()[i], y[i]);
+        BOOST_CHECK_EQUAL(source.getPositionsZ()[i], z[i]);
+        BOOST_CHECK_EQUAL(source.getRadii()[i], .5f);
+        BOOST_CHECK_EQUAL(source.getValues()[i], values[i]);
+    }
+
+    BOOST_CHECK_THROW(source.setValues(numEvents - 1, 2, 0.f),
+                      std::out_of_range);
+    BOOST_CHECK_THROW(source.setPositions(1, numEvents, x.data(), y.data(),
+                                          z.data()),
+                      std::out_of_range);
+}
+
+BOOST_AUTO_TEST_CASE(geometry_version)
+{
+    const fivox::URIHandler params(fivox::URI("fivox://"));
+    std::set<uint64_t> versions;
+    for (size_t i = 0; i < 3; ++i)
+    {
+        // a source allocated in place of a destroyed one gets a new version
+        std::unique_ptr<fivox::GenericLoader> source(
+            new fivox::GenericLoader(params));
+        BOOST_CHECK(versions.insert(source->getGeometryVersion()).second);
+
+        source->resize(10);
+        BOOST_CHECK(versions.insert(source->getGeometryVersion()).second);
+
+        for (size_t j = 0; j < 10; ++j)
+            source->update(j, fivox::Vector3f(float(j)), 1.f);
+        const uint64_t updated = source->getGeometryVersion();
+        BOOST_CHECK(versions.insert(updated).second);
+        BOOST_CHECK_EQUAL(source->getGeometryVersion(), updated);
+
+        source->setValues(0, 10, 1.f);
+        BOOST_CHECK_EQUAL(source->getGeometryVersion(), updated);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(adopt_values)
+{
+    const fivox::URIHandler params(fivox::URI("fivox://"));
+    fivox::GenericLoader source(params);
+
+    const size_t numEvents = 1000;
+    source.resize(numEvents);
+
+    // std::allocator aligns to std::max_align_t, enough to adopt the buffer
+    static_assert(alignof(std::max_align_t) >= 16, "unaligned allocations");
+    brion::floatsPtr values(new brion::floats(numEvents));
+    BOOST_REQUIRE_EQUAL(reinterpret_cast<uintptr_t>(values->data()) % 16, 0);
+    for (size_t i = 0; i < numEvents; ++i)
+        (*values)[i] = float(i);
+
+    BOOST_REQUIRE(source.adoptValues(values));
+    BOOST_CHECK_EQUAL(source.getValues(), values->data());
+    BOOST_CHECK_EQUAL(source.getValues()[42], 42.f);
+
+    // writing copies the adopted values and leaves the buffer untouched
+    source[0] = -1.f;
+    BOOST_CHECK_NE(source.getValues(), values->data());
+    BOOST_CHECK_EQUAL(source.getValues()[0], -1.f);
+    BOOST_CHECK_EQUAL(source.getValues()[42], 42.f);
+    BOOST_CHECK_EQUAL((*values)[0], 0.f);
+
+    values->resize(numEvents + 1);
+    BOOST_CHECK_THROW(source.adoptValues(values), std::out_of_range);
+}
+
+BOOST_AUTO_TEST_CASE(event_groups)
+{
+    const fivox::URIHandler params(fivox::URI("fivox://"));
+    fivox::GenericLoader source(params);
+
+    const size_t numEvents = 1000;
+    source.resize(numEvents);
+    BOOST_CHECK(!source.getGroups());
+    BOOST_CHECK_THROW(source.setGroups(0, 1, uint16_t(0)), std::out_of_range);
+
+    source.setGroupNames({"even", "odd"});
+    BOOST_CHECK_EQUAL(source.getNumGroups(), 2);
+    BOOST_REQUIRE(source.getGroups());
+    BOOST_CHECK_EQUAL(source.getGroups()[42], 0);
+
+    brion::uint16_ts groups(numEvents);
+    for (size_t i = 0; i < numEvents; ++i)
+        groups[i] = i % 2;
+    source.setGroups(0, numEvents, groups.data());
+    BOOST_CHECK_EQUAL(source.getGroups()[41], 1);
+    BOOST_CHECK_EQUAL(source.getGroups()[42], 0);
+
+    source.setGroups(numEvents - 1, 1, uint16_t(0));
+    BOOST_CHECK_EQUAL(source.getGroups()[numEvents - 1], 0);
+
+    // the groups follow the number of events
+    source.resize(numEvents / 2);
+    BOOST_CHECK_EQUAL(source.getNumGroups(), 2);
+
+    BOOST_CHECK_THROW(source.setGroups(0, 1, uint16_t(2)), std::out_of_range);
+    BOOST_CHECK_THROW(source.setGroups(numEvents / 2, 1, uint16_t(0)),
+                      std::out_of_range);
+
+    source.setGroupNames(brion::Strings());
+    BOOST_CHECK(!source.getGroups());
+}
+
+BOOST_AUTO_TEST_CASE(select_events)
+{
+    const fivox::URIHandler params(fivox::URI("fivox://"));
+    fivox::GenericLoader source(params);
+
+    const size_t numEvents = 1000;
+    source.resize(numEvents);
+    source.setGroupNames({"even", "odd"});
+    for (size_t i = 0; i < numEvents; ++i)
+    {
+        source.update(i, fivox::Vector3f(float(i), 0.f, 0.f), 2.f, float(i));
+        source.setGroups(i, 1, uint16_t(i % 2));
+    }
+    const fivox::AABBf bbox = source.getBoundingBox();
+
+    source.selectEvents({999, 3, 42});
+    BOOST_REQUIRE_EQUAL(source.getNumEvents(), 3);
+    BOOST_CHECK_EQUAL(source.getPositionsX()[0], 999.f);
+    BOOST_CHECK_EQUAL(source.getPositionsX()[1], 3.f);
+    BOOST_CHECK_EQUAL(source.getRadii()[2], .5f);
+    BOOST_CHECK_EQUAL(source.getValues()[2], 42.f);
+    BOOST_CHECK_EQUAL(source.getGroups()[0], 1);
+    BOOST_CHECK_EQUAL(source.getGroups()[2], 0);
+    BOOST_CHECK_EQUAL(source.getBoundingBox().getMin(), bbox.getMin());
+    BOOST_CHECK_EQUAL(source.getBoundingBox().getMax(), bbox.getMax());
+
+    BOOST_CHECK_THROW(source.selectEvents({3}), std::out_of_range);
+    source.selectEvents(brion::size_ts());
+    BOOST_CHECK_EQUAL(source.getNumEvents(), 0);
+
+    // generic sources do not support a region of interest
+    fivox::GenericLoader other(params);
+    other.resize(10);
+    BOOST_CHECK_EQUAL(other.setRegionOfInterest(fivox::AABBf()), 10);
+}
+
+BOOST_AUTO_TEST_CASE(sparse_values)
+{
+    const fivox::URIHandler params(fivox::URI("fivox://"));
+    fivox::GenericLoader source(params);
+
+    const size_t numEvents = 100;
+    source.resize(numEvents);
+    source.setValues(0, numEvents, 1.f);
+    BOOST_CHECK(!source.getActiveEvents());
+
+    const float values[] = {2.f, 3.f};
+    source.setSparseValues({4, 42}, values);
+    BOOST_REQUIRE(source.getActiveEvents());
+    BOOST_CHECK_EQUAL(source.getActiveEvents()->size(), 2);
+    BOOST_CHECK_EQUAL(source.getValues()[0], 0.f);
+    BOOST_CHECK_EQUAL(source.getValues()[4], 2.f);
+    BOOST_CHECK_EQUAL(source.getValues()[42], 3.f);
+    BOOST_CHECK_EQUAL(source.getValues()[99], 0.f);
+
+    // only the previous active events are reset
+    source.setSparseValues({99}, values);
+    BOOST_CHECK_EQUAL(source.getValues()[4], 0.f);
+    BOOST_CHECK_EQUAL(source.getValues()[42], 0.f);
+    BOOST_CHECK_EQUAL(source.getValues()[99], 2.f);
+    BOOST_CHECK_EQUAL(source.getActiveEvents()->front(), 99);
+
+    BOOST_CHECK_THROW(source.setSparseValues({100}, values),
+                      std::out_of_range);
+
+    // any other value change makes the active events unknown
+    source.setValues(0, 1, 5.f);
+    BOOST_CHECK(!source.getActiveEvents());
+}
+
+BOOST_AUTO_TEST_CASE(prefetch_chunks)
+{
+    const fivox::URIHandler params(fivox::URI("fivox://"));
+    ChunkSource source(params);
+
+    BOOST_CHECK_EQUAL(source.load(0, 1), 1);
+    source.prefetch(1, 1);
+
+    // the front buffer is unchanged until load() swaps the buffers
+    BOOST_CHECK_EQUAL(source.getNumEvents(), 1);
+    BOOST_CHECK_EQUAL(source.getBoundingBox().getMax().x(), 0.f);
+
+    BOOST_CHECK_EQUAL(source.load(1, 1), 2);
+    BOOST_CHECK_EQUAL(source.getNumEvents(), 2);
+    BOOST_CHECK_EQUAL(source.loadedEvents.back(), 2);
+    BOOST_CHECK_EQUAL(source.getPositionsX()[1], 1.f);
+    BOOST_CHECK_EQUAL(source.getBoundingBox().getMax().x(), 1.f);
+
+    // a failed prefetch of other chunks does not fail an unrelated load
+    source.prefetch(numChunks - 1, 1);
+    BOOST_CHECK_EQUAL(source.load(2, 1), 3);
+    BOOST_CHECK_EQUAL(source.getNumEvents(), 3);
+
+    // but the failure of the requested chunks is reported
+    source.prefetch(numChunks - 1, 1);
+    BOOST_CHECK_THROW(source.load(numChunks - 1, 1), std::runtime_error);
+    BOOST_CHECK_EQUAL(source.load(3, 1), 4);
+    BOOST_CHECK_EQUAL(source.getPositionsX()[3], 3.f);
+}
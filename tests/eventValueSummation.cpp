@@ -0,0 +1,112 @@
+/* Copyright (c) 2017, EPFL/Blue Brain Project
+ *
+ * This file is part of Fivox <https://github.com/BlueBrain/Fivox>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of Eyescale Software GmbH nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define BOOST_TEST_MODULE EventValueSummation
+
+#include "test.h"
+#include <fivox/eventValueSummationImageSource.h>
+#include <fivox/genericLoader.h>
+#include <fivox/uriHandler.h>
+
+#include <cmath>
+#include <random>
+
+namespace
+{
+const size_t size = 32;
+const size_t numEvents = 200000; // sampled by several threads
+const size_t numGroups = 3;
+}
+
+BOOST_AUTO_TEST_CASE(parallel_scatter)
+{
+    typedef itk::Image<float, 3> Image;
+    typedef fivox::EventValueSummationImageSource<Image> Source;
+
+    const fivox::URIHandler params(fivox::URI("fivox://"));
+    auto events = std::make_shared<fivox::GenericLoader>(params);
+    events->resize(numEvents);
+    events->setGroupNames({"a", "b", "c"});
+
+    // integral values, so the sums are exact in any order
+    std::mt19937 random(42);
+    std::uniform_real_distribution<float> position(-2.f, size + 2.f);
+    brion::floats x, y, z, values;
+    brion::uint16_ts groups;
+    for (size_t i = 0; i < numEvents; ++i)
+    {
+        x.push_back(position(random));
+        y.push_back(position(random));
+        z.push_back(position(random));
+        values.push_back(float(i % 7 + 1));
+        groups.push_back(i % numGroups);
+    }
+    events->setPositions(0, numEvents, x.data(), y.data(), z.data());
+    events->setRadii(0, numEvents, 1.f);
+    events->setValues(0, numEvents, values.data());
+    events->setGroups(0, numEvents, groups.data());
+
+    Source::Pointer source = Source::New();
+    source->setEventSource(events);
+    source->setLoadEvents(false);
+    source->setup(params);
+    BOOST_REQUIRE_EQUAL(source->getNumChannels(), numGroups);
+    _setSize<Image>(source->GetOutput(), size);
+
+    // serial scatter into the voxels of unit spacing at the origin
+    std::vector<brion::floats> expected(numGroups,
+                                        brion::floats(size * size * size));
+    for (size_t i = 0; i < numEvents; ++i)
+    {
+        const long vx = std::floor(x[i] + .5f);
+        const long vy = std::floor(y[i] + .5f);
+        const long vz = std::floor(z[i] + .5f);
+        if (vx < 0 || vy < 0 || vz < 0 || vx >= long(size) ||
+            vy >= long(size) || vz >= long(size))
+        {
+            continue;
+        }
+        expected[groups[i]][vx + size * (vy + size * vz)] += values[i];
+    }
+
+    // the first update scatters the events, the second one gathers them from
+    // the voxels cached for the unchanged geometry
+    for (size_t update = 0; update < 2; ++update)
+    {
+        source->Modified();
+        source->Update();
+        for (size_t c = 0; c < numGroups; ++c)
+        {
+            const float* voxels = source->GetOutput(c)->GetBufferPointer();
+            BOOST_CHECK_EQUAL_COLLECTIONS(voxels, voxels + size * size * size,
+                                          expected[c].begin(),
+                                          expected[c].end());
+        }
+    }
+}
@@ -0,0 +1,137 @@
+/* Copyright (c) 2017, EPFL/Blue Brain Project
+ *
+ * This file is part of Fivox <https://github.com/BlueBrain/Fivox>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of Eyescale Software GmbH nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define BOOST_TEST_MODULE GIDMapping
+
+#include "test.h"
+#include <fivox/gidMapping.h>
+
+#include <itkTimeProbe.h>
+
+#include <iomanip>
+#include <random>
+
+namespace
+{
+const size_t numLookups = 1000000;
+
+brion::GIDSet _createTarget(const size_t size, const uint32_t maxGID,
+                            std::mt19937& rng)
+{
+    std::uniform_int_distribution<uint32_t> distribution(1, maxGID);
+    brion::GIDSet gids;
+    while (gids.size() < size)
+        gids.insert(distribution(rng));
+    return gids;
+}
+
+void _testTarget(const std::string& name, const brion::GIDSet& gids,
+                 std::mt19937& rng)
+{
+    const fivox::GIDMapping mapping(gids);
+    BOOST_CHECK_EQUAL(mapping.size(), gids.size());
+    BOOST_CHECK_LE(mapping.getMemorySize(), 32 * gids.size());
+
+    // the former dense mapping, one entry per GID up to the largest one
+    brion::size_ts dense(*gids.rbegin() + 1, fivox::GIDMapping::invalid());
+    size_t i = 0;
+    for (const uint32_t gid : gids)
+    {
+        BOOST_CHECK_EQUAL(mapping.find(gid), i);
+        dense[gid] = i++;
+    }
+    BOOST_CHECK_EQUAL(mapping.find(0), fivox::GIDMapping::invalid());
+    BOOST_CHECK_EQUAL(mapping.find(*gids.rbegin() + 1),
+                      fivox::GIDMapping::invalid());
+
+    // spikes of random neurons of the target
+    const std::vector<uint32_t> targetGIDs(gids.begin(), gids.end());
+    std::uniform_int_distribution<size_t> distribution(0, gids.size() - 1);
+    std::vector<uint32_t> spikes(numLookups);
+    for (uint32_t& gid : spikes)
+        gid = targetGIDs[distribution(rng)];
+
+    size_t denseSum = 0;
+    itk::TimeProbe denseClock;
+    denseClock.Start();
+    for (const uint32_t gid : spikes)
+        denseSum += dense[gid];
+    denseClock.Stop();
+
+    size_t mappingSum = 0;
+    itk::TimeProbe mappingClock;
+    mappingClock.Start();
+    for (const uint32_t gid : spikes)
+        mappingSum += mapping.find(gid);
+    mappingClock.Stop();
+
+    BOOST_CHECK_EQUAL(mappingSum, denseSum);
+#ifdef NDEBUG
+    std::cout << std::setw(12) << name << ',' << std::setw(9) << gids.size()
+              << ',' << std::setw(13)
+              << numLookups / 1000000.f / denseClock.GetTotal() << ','
+              << std::setw(15)
+              << numLookups / 1000000.f / mappingClock.GetTotal() << ','
+              << std::setw(10) << dense.size() * sizeof(size_t) / 1024 << ','
+              << std::setw(11) << mapping.getMemorySize() / 1024
+              << std::endl;
+#else
+    (void)name;
+#endif
+}
+}
+
+BOOST_AUTO_TEST_CASE(gid_mapping)
+{
+    std::mt19937 rng(42);
+
+#ifdef NDEBUG
+    std::cout.setf(std::ios::right, std::ios::adjustfield);
+    std::cout.precision(5);
+    std::cout << "      Target,     GIDs, dense MLook/s, mapping MLook/s,"
+              << " dense KiB, mapping KiB" << std::endl;
+#endif
+
+    brion::GIDSet contiguous;
+    for (uint32_t gid = 1; gid <= 31346; ++gid)
+        contiguous.insert(gid);
+    _testTarget("contiguous", contiguous, rng);
+    _testTarget("sparse", _createTarget(1000, 8000000, rng), rng);
+    _testTarget("uniform", _createTarget(100000, 1000000, rng), rng);
+
+    // two dense clusters far apart
+    brion::GIDSet clustered = _createTarget(5000, 10000, rng);
+    const brion::GIDSet& far = _createTarget(5000, 10000, rng);
+    for (const uint32_t gid : far)
+        clustered.insert(gid + 5000000);
+    _testTarget("clustered", clustered, rng);
+
+    const fivox::GIDMapping empty{brion::GIDSet()};
+    BOOST_CHECK_EQUAL(empty.find(1), fivox::GIDMapping::invalid());
+}
@@ -34,7 +34,9 @@
 #include "test.h"
 #include <fivox/eventFunctor.h>
 #include <fivox/eventSource.h>
+#include <fivox/genericLoader.h>
 #include <fivox/imageSource.h>
+#include <fivox/lfpFunctor.h>
 #include <fivox/uriHandler.h>
 
 #include <itkImageFileWriter.h>
@@ -50,10 +52,14 @@
 const float expectedValue = 2.36366f;
 const float expectedValue2 = 2.81135f;
 
-BOOST_AUTO_TEST_CASE(LfpValidation)
+namespace
+{
+fivox::FloatVolume::Pointer _sampleVolume(const std::string& backend)
 {
     const fivox::URIHandler params(
-        fivox::URI("fivox://?resolution=1&cutoff=100&functor=lfp&extend=100"));
+        fivox::URI("fivox://?resolution=1&cutoff=100&functor=lfp&extend=100"
+                   "&cache=0&backend=" +
+                   backend));
     auto volumeSource = params.newImageSource<fivox::FloatVolume>();
 
     typedef fivox::FloatVolume Image;
@@ -83,9 +89,84 @@ BOOST_AUTO_TEST_CASE(LfpValidation)
     volume->SetOrigin(origin);
     volumeSource->Modified();
     volumeSource->Update();
+    return volume;
+}
+}
+
+BOOST_AUTO_TEST_CASE(LfpValidation)
+{
+    // all backends, the default one and the calibrated one
+    for (const std::string backend : {"", "voxel", "row", "auto"})
+    {
+        BOOST_TEST_MESSAGE("Backend '" << backend << "'");
+        const fivox::FloatVolume::Pointer volume = _sampleVolume(backend);
+        BOOST_CHECK_CLOSE(volume->GetPixel({{150, 150, 150}}), expectedValue,
+                          0.001f /*%*/);
+        BOOST_CHECK_CLOSE(volume->GetPixel({{50, 80, 80}}), expectedValue2,
+                          0.001f /*%*/);
+    }
+}
+
+// Compares the sampling of a row of voxels, which traverses the events in
+// blocks, with the sum over all events of each voxel.
+BOOST_AUTO_TEST_CASE(LfpRows)
+{
+    typedef fivox::FloatVolume Image;
+    const fivox::URIHandler params(fivox::URI("fivox://?cutoff=50"));
+    auto source = std::make_shared<fivox::GenericLoader>(params);
+
+    // more than one block of events, many beyond the cutoff distance
+    const size_t numEvents = 3000;
+    source->resize(numEvents);
+    uint32_t seed = 42;
+    const auto random = [&seed](const float min, const float max) {
+        seed = seed * 1664525u + 1013904223u;
+        return min + (max - min) * float(seed >> 8) / float(1u << 24);
+    };
+    for (size_t i = 0; i < numEvents; ++i)
+    {
+        const fivox::Vector3f position(random(-100.f, 100.f),
+                                       random(-100.f, 100.f),
+                                       random(-100.f, 100.f));
+        source->update(i, position, random(.5f, 2.f), random(0.f, 1.f));
+    }
+
+    fivox::LFPFunctor<Image> functor;
+    functor.setEventSource(source);
+
+    Image::PointType first;
+    first[0] = -40.;
+    first[1] = 3.;
+    first[2] = -7.;
+    Image::SpacingType spacing;
+    spacing.Fill(1.5);
+
+    const size_t count = 64;
+    std::vector<float> row(count);
+    BOOST_REQUIRE(functor.sampleRow(first, spacing, count, row.data()));
+
+    const float cutoff = source->getCutOffDistance();
+    for (size_t k = 0; k < count; ++k)
+    {
+        const fivox::Vector3f voxel(first[0] + k * spacing[0], first[1],
+                                    first[2]);
+        double current = 0.;
+        for (size_t i = 0; i < numEvents; ++i)
+        {
+            const fivox::Vector3f position(source->getPositionsX()[i],
+                                           source->getPositionsY()[i],
+                                           source->getPositionsZ()[i]);
+            const float distance = (voxel - position).length();
+            if (distance > cutoff)
+                continue;
+            current += source->getValues()[i] *
+                       std::min(source->getRadii()[i], 1.f / distance);
+        }
+        const float expected = 0.281704249 * current;
 
-    BOOST_CHECK_CLOSE(volume->GetPixel({{150, 150, 150}}), expectedValue,
-                      0.001f /*%*/);
-    BOOST_CHECK_CLOSE(volume->GetPixel({{50, 80, 80}}), expectedValue2,
-                      0.001f /*%*/);
+        BOOST_CHECK_CLOSE(row[k], expected, 0.01f /*%*/);
+        Image::PointType point = first;
+        point[0] = voxel[0];
+        BOOST_CHECK_CLOSE(functor(point, spacing), expected, 0.01f /*%*/);
+    }
 }
@@ -40,9 +40,7 @@
 #include <fivox/genericLoader.h>
 #include <fivox/helpers.h>
 #include <fivox/imageSource.h>
-#ifdef FIVOX_USE_LFP
-#include <fivox/lfp/lfpFunctor.h>
-#endif
+#include <brain/spikeReportReader.h>
 #include <brion/spikeReport.h>
 #include <fivox/somaLoader.h>
 #include <fivox/spikeLoader.h>
@@ -59,6 +57,7 @@
 #include <lunchbox/sleep.h>
 
 #include <iomanip>
+#include <numeric>
 
 #define STARTUP_DELAY 250
 #define WRITE_DELAY 100
@@ -255,7 +254,6 @@ BOOST_AUTO_TEST_CASE(fivoxSomas_source)
                vmml::Vector2ui(0, 100));
 }
 
-#ifdef FIVOX_USE_LFP
 BOOST_AUTO_TEST_CASE(fivoxLFP_source)
 {
     // Compartment currents report 'currents' (binary) contains timestamps
@@ -263,7 +261,6 @@ BOOST_AUTO_TEST_CASE(fivoxLFP_source)
     testSource(fivox::URI("fivoxcompartments://?functor=lfp"), 0.f,
                3.3634767649011466e-09f, vmml::Vector2ui(0, 100));
 }
-#endif
 
 BOOST_AUTO_TEST_CASE(fivoxSpikes_source)
 {
@@ -285,8 +282,215 @@ BOOST_AUTO_TEST_CASE(fivoxVSD_source)
                -85293.598821282387f, vmml::Vector2ui(0, 100));
 }
 
+BOOST_AUTO_TEST_CASE(fivoxSpikes_sliding_window)
+{
+    const fivox::URIHandler params(
+        fivox::URI("fivoxspikes://?duration=2&dt=0.5&target=Column"));
+    fivox::SpikeLoader loader(params);
+    brain::SpikeReportReader reader(params.getConfig().getSpikeSource(),
+                                    params.getGIDs());
+
+    const vmml::Vector2ui& range = loader.getFrameRange();
+    BOOST_REQUIRE_GT(range.y(), range.x() + 4);
+
+    // overlapping windows forward and backward, then non-overlapping jumps
+    std::vector<uint32_t> frames;
+    for (uint32_t i = range.x(); i < range.y(); ++i)
+        frames.push_back(i);
+    for (uint32_t i = range.y(); i > range.x(); --i)
+        frames.push_back(i - 1);
+    frames.push_back(range.y() - 1);
+    frames.push_back(range.x());
+
+    for (const uint32_t frame : frames)
+    {
+        BOOST_REQUIRE(loader.setFrame(frame));
+        const float start = loader.getCurrentTime();
+        const size_t expected =
+            reader.getSpikes(start, start + loader.getDuration()).size();
+
+        BOOST_CHECK_EQUAL(loader.load(), ssize_t(expected));
+        const float* values = loader.getValues();
+        BOOST_CHECK_EQUAL(std::accumulate(values,
+                                          values + loader.getNumEvents(), 0.f),
+                          float(expected));
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
+BOOST_AUTO_TEST_CASE(fivoxSynapses_cache)
+{
+    const boost::filesystem::path cacheDir =
+        boost::filesystem::temp_directory_path() /
+        boost::filesystem::unique_path();
+    const fivox::URIHandler params(fivox::URI(
+        "fivoxsynapses://?target=Column&cacheDir=" + cacheDir.string()));
+
+    // first loader reads the circuit and writes the cache after a full pass,
+    // the second one reads the positions from the cache
+    fivox::SynapseLoader reader(params);
+    const size_t numChunks = reader.getNumChunks();
+    std::vector<size_t> sizes;
+    for (size_t i = 0; i < numChunks; ++i)
+        sizes.push_back(reader.load(i, 1));
+    BOOST_CHECK(!boost::filesystem::is_empty(cacheDir));
+
+    fivox::SynapseLoader cached(params);
+    BOOST_CHECK_EQUAL(cached.getNumChunks(), numChunks);
+    BOOST_CHECK_EQUAL(cached.getBoundingBox().getMin(),
+                      reader.getBoundingBox().getMin());
+    BOOST_CHECK_EQUAL(cached.getBoundingBox().getMax(),
+                      reader.getBoundingBox().getMax());
+    BOOST_CHECK_EQUAL(cached.load(0, numChunks),
+                      ssize_t(std::accumulate(sizes.begin(), sizes.end(),
+                                              size_t(0))));
+    for (size_t i = 0; i < numChunks; ++i)
+        BOOST_CHECK_EQUAL(cached.load(i, 1), ssize_t(sizes[i]));
+
+    boost::filesystem::remove_all(cacheDir);
+}
+
+BOOST_AUTO_TEST_CASE(fivoxSynapses_chunks)
+{
+    const fivox::URIHandler params(fivox::URI(
+        "fivoxsynapses://?target=MiniColumn_0&readers=2&readSize=3&cache=0"));
+    fivox::SynapseLoader loader(params);
+    const size_t numChunks = loader.getNumChunks();
+    BOOST_REQUIRE_GT(numChunks, 4);
+
+    std::vector<ssize_t> sizes;
+    for (size_t i = 0; i < numChunks; ++i)
+        sizes.push_back(loader.load(i, 1));
+
+    // batches split across the reads and readers
+    for (size_t i = 0; i < numChunks; i += 2)
+    {
+        const size_t count = std::min(size_t(2), numChunks - i);
+        BOOST_CHECK_EQUAL(loader.load(i, count),
+                          std::accumulate(sizes.begin() + i,
+                                          sizes.begin() + i + count,
+                                          ssize_t(0)));
+    }
+
+    // seeking restarts the readers
+    BOOST_CHECK_EQUAL(loader.load(numChunks - 1, 1), sizes.back());
+    BOOST_CHECK_EQUAL(loader.load(1, 1), sizes[1]);
+    BOOST_CHECK_EQUAL(loader.load(0, numChunks),
+                      std::accumulate(sizes.begin(), sizes.end(), ssize_t(0)));
+}
+
+BOOST_AUTO_TEST_CASE(fivoxSynapses_overlapping_pretargets)
+{
+    // a synapse can only be in one group, MiniColumn_0 is part of Column
+    const fivox::URIHandler params(
+        fivox::URI("fivoxsynapses://?target=Column&groupBy=preTarget&"
+                   "preTarget=Column,MiniColumn_0&cache=0"));
+    BOOST_CHECK_THROW(fivox::SynapseLoader loader(params), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(fivoxCompartments_cache)
+{
+    const boost::filesystem::path cacheDir =
+        boost::filesystem::temp_directory_path() /
+        boost::filesystem::unique_path();
+    const fivox::URIHandler params(
+        fivox::URI("fivoxcompartments://?cacheDir=" + cacheDir.string()));
+
+    // first loader computes the events from the morphologies and writes the
+    // cache, the second one reads them from the cache
+    const fivox::CompartmentLoader loader(params);
+    BOOST_CHECK(!boost::filesystem::is_empty(cacheDir));
+
+    const fivox::CompartmentLoader cached(params);
+    const size_t numEvents = loader.getNumEvents();
+    BOOST_REQUIRE_EQUAL(cached.getNumEvents(), numEvents);
+    BOOST_CHECK_EQUAL_COLLECTIONS(loader.getPositionsX(),
+                                  loader.getPositionsX() + numEvents,
+                                  cached.getPositionsX(),
+                                  cached.getPositionsX() + numEvents);
+    BOOST_CHECK_EQUAL_COLLECTIONS(loader.getPositionsY(),
+                                  loader.getPositionsY() + numEvents,
+                                  cached.getPositionsY(),
+                                  cached.getPositionsY() + numEvents);
+    BOOST_CHECK_EQUAL_COLLECTIONS(loader.getPositionsZ(),
+                                  loader.getPositionsZ() + numEvents,
+                                  cached.getPositionsZ(),
+                                  cached.getPositionsZ() + numEvents);
+    BOOST_CHECK_EQUAL_COLLECTIONS(loader.getRadii(),
+                                  loader.getRadii() + numEvents,
+                                  cached.getRadii(),
+                                  cached.getRadii() + numEvents);
+    BOOST_CHECK_EQUAL(cached.getBoundingBox().getMin(),
+                      loader.getBoundingBox().getMin());
+    BOOST_CHECK_EQUAL(cached.getBoundingBox().getMax(),
+                      loader.getBoundingBox().getMax());
+
+    boost::filesystem::remove_all(cacheDir);
+}
+
+namespace
+{
+/** Returns the time as the only value of a frame, counting the reads */
+struct CountingReport
+{
+    std::future<brion::floatsPtr> loadFrame(const double time)
+    {
+        ++reads[time];
+        return std::async(std::launch::async, [time] {
+            return brion::floatsPtr(new brion::floats(1, float(time)));
+        });
+    }
+
+    std::map<double, size_t> reads;
+};
+}
+
+BOOST_AUTO_TEST_CASE(frameReader_prefetch)
+{
+    CountingReport report;
+    fivox::helpers::FrameReader<CountingReport> reader(report);
+
+    // like the apps: prefetch the next frame before the current one is used
+    const size_t numFrames = 10;
+    for (size_t i = 0; i < numFrames; ++i)
+    {
+        if (i + 1 < numFrames)
+            reader.prefetch(i + 1);
+        BOOST_CHECK_EQUAL((*reader.load(i))[0], float(i));
+    }
+
+    BOOST_CHECK_EQUAL(report.reads.size(), numFrames);
+    for (const auto& reads : report.reads)
+        BOOST_CHECK_EQUAL(reads.second, 1);
+}
+
+BOOST_AUTO_TEST_CASE(fivoxCompartments_region_of_interest)
+{
+    const fivox::URIHandler params(fivox::URI("fivoxcompartments://"));
+    fivox::CompartmentLoader loader(params);
+    const size_t numEvents = loader.getNumEvents();
+    const fivox::AABBf bbox = loader.getBoundingBox();
+
+    // the lower half of the circuit along X
+    fivox::Vector3f max = bbox.getMax();
+    max[0] = bbox.getCenter()[0];
+    const size_t numSelected =
+        loader.setRegionOfInterest(fivox::AABBf(bbox.getMin(), max));
+    BOOST_CHECK_GT(numSelected, 0);
+    BOOST_CHECK_LT(numSelected, numEvents);
+    BOOST_CHECK_EQUAL(loader.getBoundingBox().getMax(), bbox.getMax());
+
+    BOOST_REQUIRE(loader.setFrame(0));
+    BOOST_CHECK_EQUAL(loader.load(), ssize_t(numSelected));
+
+    BOOST_CHECK_EQUAL(loader.setRegionOfInterest(fivox::AABBf(
+                          bbox.getMax() + fivox::Vector3f(1.f),
+                          bbox.getMax() + fivox::Vector3f(2.f))),
+                      0);
+    BOOST_CHECK_EQUAL(loader.load(), 0);
+}
+
 #if FIVOX_USE_MONSTEER
 
 BOOST_AUTO_TEST_CASE(fivoxSpikes_stream_source_frame_range)
@@ -0,0 +1,120 @@
+/* Copyright (c) 2017, EPFL/Blue Brain Project
+ *
+ * This file is part of Fivox <https://github.com/BlueBrain/Fivox>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of Eyescale Software GmbH nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#define BOOST_TEST_MODULE SpikeStore
+
+#include "test.h"
+#include <fivox/spikeLoader.h>
+#include <fivox/spikeStore.h>
+#include <fivox/uriHandler.h>
+
+#include <brain/spikeReportReader.h>
+#include <brion/blueConfig.h>
+
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+
+namespace
+{
+const std::string _volume("fivoxspikes://?duration=1&dt=1&target=Column");
+
+std::string _getTempPath(const std::string& suffix)
+{
+    return (boost::filesystem::temp_directory_path() /
+            boost::filesystem::unique_path())
+               .string() +
+           suffix;
+}
+}
+
+BOOST_AUTO_TEST_CASE(convert)
+{
+    const fivox::URIHandler params{fivox::URI(_volume)};
+    const fivox::URI& report = params.getConfig().getSpikeSource();
+    const std::string store = _getTempPath(".fivoxspikes");
+    fivox::SpikeStore::convert(report, store);
+
+    const fivox::SpikeStore spikes(store);
+    brain::SpikeReportReader reader(report);
+    BOOST_CHECK_EQUAL(spikes.getEndTime(), reader.getEndTime());
+    BOOST_CHECK_GT(spikes.getNumSpikes(), 0);
+
+    for (float start = 0.f; start < spikes.getEndTime(); start += 0.37f)
+    {
+        const float end = start + 1.f;
+        brion::Spikes expected = reader.getSpikes(start, end);
+        std::sort(expected.begin(), expected.end());
+
+        const fivox::SpikeStore::SpikeRange& range =
+            spikes.getSpikes(start, end);
+        BOOST_REQUIRE_EQUAL(size_t(range.second - range.first),
+                            expected.size());
+        BOOST_CHECK(std::equal(range.first, range.second, expected.begin()));
+    }
+    boost::filesystem::remove(store);
+
+    BOOST_CHECK_THROW(fivox::SpikeStore(report.getPath()), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(spike_loader_cache)
+{
+    const fivox::URIHandler params{fivox::URI(_volume)};
+    const fivox::URI& report = params.getConfig().getSpikeSource();
+
+    // the cache is written next to the report, use a copy of the report
+    const std::string reportCopy = _getTempPath(
+        boost::filesystem::path(report.getPath()).extension().string());
+    boost::filesystem::copy_file(report.getPath(), reportCopy);
+    const fivox::URI copyURI(reportCopy);
+    BOOST_CHECK(!fivox::SpikeStore::hasCache(copyURI));
+    fivox::SpikeStore::convert(copyURI,
+                               fivox::SpikeStore::getCachePath(copyURI));
+    BOOST_CHECK(fivox::SpikeStore::hasCache(copyURI));
+
+    fivox::SpikeLoader loader(params);
+    fivox::SpikeLoader cachedLoader(
+        fivox::URIHandler(fivox::URI(_volume + "&spikes=" + reportCopy)));
+    BOOST_CHECK_EQUAL(loader.getFrameRange(), cachedLoader.getFrameRange());
+
+    const fivox::Vector2ui& frames = loader.getFrameRange();
+    for (uint32_t frame = frames.x(); frame < frames.y(); ++frame)
+    {
+        BOOST_REQUIRE(loader.setFrame(frame));
+        BOOST_REQUIRE(cachedLoader.setFrame(frame));
+        BOOST_CHECK_EQUAL(loader.load(), cachedLoader.load());
+        BOOST_CHECK(std::equal(loader.getValues(),
+                               loader.getValues() + loader.getNumEvents(),
+                               cachedLoader.getValues()));
+    }
+
+    boost::filesystem::remove(fivox::SpikeStore::getCachePath(copyURI));
+    boost::filesystem::remove(reportCopy);
+}
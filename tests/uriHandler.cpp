@@ -58,6 +58,10 @@ BOOST_AUTO_TEST_CASE(compartment_defaults)
     BOOST_CHECK_EQUAL(handler.getDt(), -1.f);
     BOOST_CHECK_EQUAL(handler.getDuration(), 1.0);
     BOOST_CHECK_EQUAL(handler.getMaxBlockSize(), LB_64MB);
+    BOOST_CHECK_EQUAL(handler.getFrameCacheSize(), 1024 * LB_1MB);
+    BOOST_CHECK_EQUAL(handler.getBrickCacheSize(), 1024 * LB_1MB);
+    BOOST_CHECK(handler.getBrickCacheDir().empty());
+    BOOST_CHECK(handler.getEventLOD());
 }
 
 BOOST_AUTO_TEST_CASE(compartment_full_circuit)
@@ -117,6 +121,27 @@ BOOST_AUTO_TEST_CASE(synapses)
     BOOST_CHECK_EQUAL(handler.getReport(), "voltages");
 }
 
+BOOST_AUTO_TEST_CASE(cache_dir)
+{
+    const fivox::URIHandler defaults(fivox::URI("fivoxsynapses://"));
+    BOOST_CHECK(defaults.getCacheDir().empty());
+
+    const fivox::URIHandler enabled(fivox::URI("fivoxsynapses://?cache=1"));
+    BOOST_CHECK(!enabled.getCacheDir().empty());
+
+    const fivox::URIHandler custom(
+        fivox::URI("fivoxsynapses://?cacheDir=/tmp/fivox"));
+    BOOST_CHECK_EQUAL(custom.getCacheDir(), "/tmp/fivox");
+
+    const fivox::URIHandler disabled(
+        fivox::URI("fivoxsynapses://?cache=0&cacheDir=/tmp/fivox"));
+    BOOST_CHECK(disabled.getCacheDir().empty());
+
+    const fivox::URIHandler limited(
+        fivox::URI("fivoxsynapses://?cacheSize=1048576"));
+    BOOST_CHECK_EQUAL(limited.getCacheSize(), 1048576);
+}
+
 BOOST_AUTO_TEST_CASE(vsd)
 {
     const fivox::URIHandler handler(fivox::URI("fivoxvsd://"));